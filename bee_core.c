@@ -0,0 +1,1158 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+#ifdef __GLIBC__
+#endif
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include "bee_core.h"
+#include "flower_grid.h"
+#include "bee_kernels.h"
+#include "world.h"
+#include "state_buckets.h"
+#include "calendar.h"
+#include "sim_config.h"
+
+// a follower starts foraging once it is this close to the dance's flower
+#define FOLLOWER_ARRIVAL 10.0f
+// longest a bee stays parked, so wake steps cannot overflow
+#define MAX_PARKED_STEPS (1 << 24)
+
+float distance(Vector2D a, Vector2D b)
+{
+    float dx = a.x - b.x;
+    float dy = a.y - b.y;
+    return sqrtf(dx * dx + dy * dy);
+}
+
+Vector2D random_position(Rng *rng)
+{
+    Vector2D pos;
+    pos.x = rng_float(rng, 0, sim_config.world_size);
+    pos.y = rng_float(rng, 0, sim_config.world_size);
+    return pos;
+}
+
+void strip_bounds(int rank, int size, float *lo, float *hi)
+{
+    *lo = rank == 0 ? -INFINITY : sim_config.world_size * rank / size;
+    *hi = rank == size - 1 ? INFINITY : sim_config.world_size * (rank + 1) / size;
+}
+
+int strip_owner(float x, int size)
+{
+    int r = (int)(x * size / sim_config.world_size);
+    r = r < 0 ? 0 : (r >= size ? size - 1 : r);
+
+    // the guess can be off by one where rounding differs from strip_bounds
+    float lo, hi;
+    strip_bounds(r, size, &lo, &hi);
+    if (x < lo)
+        r--;
+    else if (x >= hi)
+        r++;
+    return r;
+}
+
+static void *alloc_array(int n, size_t elem_size)
+{
+    // 64-byte aligned so the kernels get full-width vector loads
+    size_t bytes = ((size_t)n * elem_size + 63) & ~(size_t)63;
+    return aligned_alloc(64, bytes > 0 ? bytes : 64);
+}
+
+void alloc_bees(BeeArrays *bees, int num_bees)
+{
+    bees->x = (float *)alloc_array(num_bees, sizeof(float));
+    bees->y = (float *)alloc_array(num_bees, sizeof(float));
+    bees->energy = (float *)alloc_array(num_bees, sizeof(float));
+    bees->state = (unsigned char *)alloc_array(num_bees, sizeof(unsigned char));
+    bees->target_flower = (int *)alloc_array(num_bees, sizeof(int));
+    bees->following_dance = (int *)alloc_array(num_bees, sizeof(int));
+    bees->target_x = (float *)alloc_array(num_bees, sizeof(float));
+    bees->target_y = (float *)alloc_array(num_bees, sizeof(float));
+    bees->nectar_found = (float *)alloc_array(num_bees, sizeof(float));
+    bees->dance_followers = (int *)alloc_array(num_bees, sizeof(int));
+    bees->dance_timer = (int *)alloc_array(num_bees, sizeof(int));
+    bees->flight_dist = (float *)alloc_array(num_bees, sizeof(float));
+}
+
+void free_bees(BeeArrays *bees)
+{
+    free(bees->x);
+    free(bees->y);
+    free(bees->energy);
+    free(bees->state);
+    free(bees->target_flower);
+    free(bees->following_dance);
+    free(bees->target_x);
+    free(bees->target_y);
+    free(bees->nectar_found);
+    free(bees->dance_followers);
+    free(bees->dance_timer);
+    free(bees->flight_dist);
+}
+
+void bee_fields(BeeArrays *bees, char **ptr, int *elem_size)
+{
+    ptr[0] = (char *)bees->x, elem_size[0] = sizeof(float);
+    ptr[1] = (char *)bees->y, elem_size[1] = sizeof(float);
+    ptr[2] = (char *)bees->energy, elem_size[2] = sizeof(float);
+    ptr[3] = (char *)bees->state, elem_size[3] = sizeof(unsigned char);
+    ptr[4] = (char *)bees->target_flower, elem_size[4] = sizeof(int);
+    ptr[5] = (char *)bees->following_dance, elem_size[5] = sizeof(int);
+    ptr[6] = (char *)bees->target_x, elem_size[6] = sizeof(float);
+    ptr[7] = (char *)bees->target_y, elem_size[7] = sizeof(float);
+    ptr[8] = (char *)bees->nectar_found, elem_size[8] = sizeof(float);
+    ptr[9] = (char *)bees->dance_followers, elem_size[9] = sizeof(int);
+    ptr[10] = (char *)bees->dance_timer, elem_size[10] = sizeof(int);
+}
+
+// First id with x >= v; the world file keeps the bees sorted by x
+static int first_bee_at(const float *x, int n, float v)
+{
+    int lo = 0, hi = n;
+    while (lo < hi)
+    {
+        int mid = lo + (hi - lo) / 2;
+        if (x[mid] < v)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+int init_bees(BeeArrays *bees, int num_bees, float lo, float hi, StateBuckets *buckets)
+{
+    // a world file holds the strip as one id range, so only its pages are
+    // read; a generated world draws every position but keeps the strip's
+    const World *world = world_current();
+    int first = world ? first_bee_at(world->bee_x, num_bees, lo) : 0;
+    int last = world ? first_bee_at(world->bee_x, num_bees, hi) : num_bees;
+
+    int n = 0;
+    for (int i = first; i < last; i++)
+    {
+        float x, y, energy;
+        unsigned char state;
+        if (world)
+        {
+            x = world->bee_x[i];
+            y = world->bee_y[i];
+            energy = world->bee_energy[i];
+            state = world->bee_state[i];
+            if (!(x >= lo && x < hi) || state >= NUM_BEE_STATES)
+            {
+                printf("Error: bee %d of the world file is out of order or has a bad state\n", i);
+                return -1;
+            }
+        }
+        else
+        {
+            Rng rng = rng_stream(sim_config.seed, RNG_INIT_BEES, i, 0);
+            x = HIVE_X + rng_float(&rng, -sim_config.hive_radius, sim_config.hive_radius);
+            y = HIVE_Y + rng_float(&rng, -sim_config.hive_radius, sim_config.hive_radius);
+            if (!(x >= lo && x < hi))
+                continue;
+            state = i < (int)(num_bees * sim_config.scout_ratio) ? SCOUT : IDLE;
+            energy = sim_config.max_energy;
+        }
+
+        n++;
+        bees->x[i] = x;
+        bees->y[i] = y;
+        bees->state[i] = state;
+        bees->energy[i] = energy;
+        bees->target_flower[i] = -1;
+        bees->following_dance[i] = -1;
+        bees->target_x[i] = HIVE_X;
+        bees->target_y[i] = HIVE_Y;
+        bees->nectar_found[i] = 0;
+        bees->dance_followers[i] = 0;
+        bees->dance_timer[i] = 0;
+        bees->flight_dist[i] = 0;
+        buckets_add(buckets, bees->state, &i, 1);
+    }
+    return n;
+}
+
+void init_flowers(Flower *flowers, int num_flowers)
+{
+    const World *world = world_current();
+    for (int i = 0; i < num_flowers; i++)
+    {
+        if (world)
+        {
+            flowers[i].position.x = world->flower_x[i];
+            flowers[i].position.y = world->flower_y[i];
+            flowers[i].nectar_total = world->flower_nectar[i];
+            flowers[i].regen_rate = world->flower_regen[i];
+            flowers[i].capacity = world->flower_capacity[i];
+        }
+        else
+        {
+            Rng rng = rng_stream(sim_config.seed, RNG_INIT_FLOWERS, i, 0);
+            flowers[i].position = random_position(&rng);
+            flowers[i].nectar_total = sim_config.flower_nectar_max;
+            flowers[i].regen_rate = sim_config.nectar_regen_rate;
+            flowers[i].capacity = sim_config.flower_capacity;
+        }
+        flowers[i].nectar_available = flowers[i].nectar_total;
+        flowers[i].nectar_step = 0;
+    }
+}
+
+static int thread_id(void)
+{
+#ifdef _OPENMP
+    return omp_get_thread_num();
+#else
+    return 0;
+#endif
+}
+
+static int team_size(void)
+{
+#ifdef _OPENMP
+    return omp_get_num_threads();
+#else
+    return 1;
+#endif
+}
+
+// Makes room for a context per thread of the next parallel region
+static void reserve_thread_contexts(Simulation *sim)
+{
+#ifdef _OPENMP
+    int n = omp_get_max_threads();
+#else
+    int n = 1;
+#endif
+    if (n <= sim->num_threads)
+        return;
+
+    sim->threads = (ThreadContext **)realloc(sim->threads, n * sizeof(ThreadContext *));
+    for (int t = sim->num_threads; t < n; t++)
+    {
+        sim->threads[t] = NULL;
+    }
+    sim->num_threads = n;
+}
+
+// The calling thread's context, allocated by that thread on first use
+static ThreadContext *thread_context(Simulation *sim)
+{
+    int t = thread_id();
+    if (!sim->threads[t])
+    {
+        ThreadContext *ctx = (ThreadContext *)aligned_alloc(64, sizeof(ThreadContext));
+        memset(ctx, 0, sizeof(ThreadContext));
+        sim->threads[t] = ctx;
+    }
+    return sim->threads[t];
+}
+
+static void free_thread_contexts(Simulation *sim)
+{
+    for (int t = 0; t < sim->num_threads; t++)
+    {
+        if (sim->threads[t])
+        {
+            free(sim->threads[t]->dances);
+            free(sim->threads[t]->followers);
+            free(sim->threads[t]);
+        }
+    }
+    free(sim->threads);
+}
+
+Simulation *create_simulation(int rank, int size)
+{
+    const World *world = world_current();
+    if (world && (world->num_bees != sim_config.num_bees || world->num_flowers != sim_config.num_flowers))
+    {
+        printf("Error: num_bees and num_flowers must match the world file\n");
+        return NULL;
+    }
+
+    Simulation *sim = (Simulation *)malloc(sizeof(Simulation));
+
+    alloc_bees(&sim->bees, sim_config.num_bees);
+    sim->flowers = (Flower *)malloc(sim_config.num_flowers * sizeof(Flower));
+    sim->dances = NULL;
+    sim->dance_prefix = NULL;
+    sim->num_dances = 0;
+    sim->dance_capacity = 0;
+    sim->threads = NULL;
+    sim->num_threads = 0;
+    sim->total_nectar_collected = 0;
+    sim->timestep = 0;
+
+    float lo, hi;
+    strip_bounds(rank, size, &lo, &hi);
+    buckets_build(&sim->buckets, sim->bees.state, NULL, 0);
+    int num_owned = init_bees(&sim->bees, sim_config.num_bees, lo, hi, &sim->buckets);
+    calendar_init(&sim->calendar, CALENDAR_DAYS);
+
+    init_flowers(sim->flowers, sim_config.num_flowers);
+    int grid_status =
+        flower_grid_build(&sim->flower_grid, sim->flowers, sim_config.num_flowers, sim_config.bee_vision_range);
+    sim->kernels = bee_kernels_select();
+
+    sim->demands = NULL;
+    sim->num_demands = 0;
+    sim->demand_capacity = 0;
+    sim->num_foragers = 0;
+    sim->park_steps = NULL;
+    sim->park_steps_capacity = 0;
+    sim->flower_counts = NULL;
+    sim->grouped = NULL;
+    sim->grouped_capacity = 0;
+    sim->group_start = NULL;
+    sim->group_start_capacity = 0;
+
+    if (grid_status != 0)
+        printf("Error: cannot allocate the flower grid\n");
+    if (num_owned < 0 || grid_status != 0)
+    {
+        destroy_simulation(sim);
+        return NULL;
+    }
+    return sim;
+}
+
+void destroy_simulation(Simulation *sim)
+{
+    free_thread_contexts(sim);
+    flower_grid_free(&sim->flower_grid);
+    buckets_free(&sim->buckets);
+    calendar_free(&sim->calendar);
+    free_bees(&sim->bees);
+    free(sim->demands);
+    free(sim->park_steps);
+    free(sim->flower_counts);
+    free(sim->grouped);
+    free(sim->group_start);
+    free(sim->flowers);
+    free(sim->dances);
+    free(sim->dance_prefix);
+    free(sim);
+}
+
+void reserve_dances(Simulation *sim, int n)
+{
+    if (n <= sim->dance_capacity)
+        return;
+
+    int grown = sim->dance_capacity * 2 > n ? sim->dance_capacity * 2 : n;
+    sim->dances = (WaggleDance *)realloc(sim->dances, (size_t)grown * sizeof(WaggleDance));
+    sim->dance_prefix = (float *)realloc(sim->dance_prefix, (size_t)grown * sizeof(float));
+    sim->dance_capacity = grown;
+}
+
+// buf with room for needed elements; grows by doubling and never shrinks
+static void *reserve_scratch(void *buf, int *capacity, int needed, size_t elem_size)
+{
+    if (needed <= *capacity)
+        return buf;
+
+    *capacity = *capacity * 2 > needed ? *capacity * 2 : needed;
+    return realloc(buf, (size_t)*capacity * elem_size);
+}
+
+static void reserve_demands(Simulation *sim, int n)
+{
+    if (n <= sim->demand_capacity)
+        return;
+
+    int grown = sim->demand_capacity * 2 > n ? sim->demand_capacity * 2 : n;
+    sim->demands = (HarvestDemand *)realloc(sim->demands, (size_t)grown * sizeof(HarvestDemand));
+    sim->demand_capacity = grown;
+}
+
+// Bees per kernel call: whole vectors, and few enough calls that the
+// indirect call costs nothing
+#define KERNEL_BLOCK 512
+
+void move_bees(Simulation *sim, const int *ids, int n, int to_hive)
+{
+    int num_blocks = (n + KERNEL_BLOCK - 1) / KERNEL_BLOCK;
+#pragma omp for schedule(static)
+    for (int blk = 0; blk < num_blocks; blk++)
+    {
+        int start = blk * KERNEL_BLOCK;
+        int count = n - start < KERNEL_BLOCK ? n - start : KERNEL_BLOCK;
+        sim->kernels.move(&sim->bees, ids + start, count, to_hive);
+    }
+}
+
+void scout_behavior(Simulation *sim, int i)
+{
+    BeeArrays *bees = &sim->bees;
+
+    if (bees->target_flower[i] == -1)
+    {
+        Rng rng = rng_stream(sim_config.seed, RNG_SCOUT, i, sim->timestep);
+
+        // Levy flight until no flower found
+        if (rng_float(&rng, 0, 1) < 0.5f)
+        {
+            bees->x[i] += rng_float(&rng, -sim_config.bee_speed, sim_config.bee_speed);
+            bees->y[i] += rng_float(&rng, -sim_config.bee_speed, sim_config.bee_speed);
+        }
+        else
+        {
+            bees->x[i] += rng_float(&rng, -sim_config.bee_speed * 10, sim_config.bee_speed * 10);
+            bees->y[i] += rng_float(&rng, -sim_config.bee_speed * 10, sim_config.bee_speed * 10);
+        }
+
+        Vector2D pos = {bees->x[i], bees->y[i]};
+        int found = flower_grid_find(&sim->flower_grid, sim->flowers, pos, sim_config.bee_vision_range, sim->timestep);
+        if (found >= 0)
+        {
+            bees->target_flower[i] = found;
+            bees->nectar_found[i] = flower_nectar(&sim->flowers[found], sim->timestep);
+            bees->state[i] = RETURNING;
+        }
+    }
+
+    bees->energy[i] -= sim_config.energy_cost;
+}
+
+// Runs after move_bees has flown the bee one step towards the hive
+void returning_behavior(Simulation *sim, ThreadContext *ctx, int i)
+{
+    BeeArrays *bees = &sim->bees;
+
+    float dx = bees->x[i] - HIVE_X;
+    float dy = bees->y[i] - HIVE_Y;
+    float dist_to_hive = sqrtf(dx * dx + dy * dy);
+    if (dist_to_hive < sim_config.hive_radius)
+    {
+        // only a bee that knows a flower has something to advertise
+        if (bees->target_flower[i] >= 0)
+        {
+            bees->state[i] = DANCING;
+            bees->dance_timer[i] = sim_config.dance_duration;
+            create_dance(sim, ctx, i);
+        }
+        else
+        {
+            bees->state[i] = IDLE;
+        }
+    }
+}
+
+void dancing_behavior(BeeArrays *bees, int i)
+{
+    bees->dance_timer[i]--;
+    if (bees->dance_timer[i] <= 0)
+    {
+        if (bees->dance_followers[i] > 0)
+        {
+            bees->state[i] = FORAGING;
+        }
+        else
+        {
+            bees->state[i] = IDLE;
+            bees->target_flower[i] = -1;
+        }
+        bees->dance_followers[i] = 0;
+    }
+}
+
+void create_dance(Simulation *sim, ThreadContext *ctx, int i)
+{
+    WaggleDance dance;
+    dance.bee_id = i;
+    dance.flower_location = sim->flowers[sim->bees.target_flower[i]].position;
+    dance.nectar_quality = sim->bees.nectar_found[i] / sim_config.flower_nectar_max;
+
+    Vector2D hive_pos = {HIVE_X, HIVE_Y};
+    dance.distance_from_hive = distance(hive_pos, dance.flower_location);
+    dance.followers = 0;
+    dance.owner = 0;
+
+    // into the thread's own buffer; update_bees merges the buffers
+    if (ctx->num_dances == ctx->dance_capacity)
+    {
+        ctx->dance_capacity = ctx->dance_capacity ? 2 * ctx->dance_capacity : 64;
+        ctx->dances = (WaggleDance *)realloc(ctx->dances, ctx->dance_capacity * sizeof(WaggleDance));
+    }
+    ctx->dances[ctx->num_dances++] = dance;
+}
+
+float calculate_dance_attractiveness(WaggleDance *dance)
+{
+    float quality_factor = dance->nectar_quality * 2.0f;
+    float distance_penalty = 1.0f / (1.0f + dance->distance_from_hive / 100.0f);
+    float follower_bonus = 1.0f + (dance->followers * 0.1f);
+
+    return quality_factor * distance_penalty * follower_bonus;
+}
+
+void build_dance_table(Simulation *sim)
+{
+    // summed in dance order, so each entry equals the running total the
+    // old linear walk computed
+    float cumulative = 0.0f;
+    for (int i = 0; i < sim->num_dances; i++)
+    {
+        cumulative += calculate_dance_attractiveness(&sim->dances[i]);
+        sim->dance_prefix[i] = cumulative;
+    }
+}
+
+int choose_dance(Simulation *sim, Rng *rng)
+{
+    if (sim->num_dances == 0)
+        return -1;
+
+    float total_score = sim->dance_prefix[sim->num_dances - 1];
+
+    if (total_score < 0.0001f)
+        return -1;
+
+    float random_val = rng_float(rng, 0, total_score);
+
+    // first dance whose running total reaches random_val
+    int lo = 0, hi = sim->num_dances;
+    while (lo < hi)
+    {
+        int mid = lo + (hi - lo) / 2;
+        if (random_val <= sim->dance_prefix[mid])
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+
+    return lo < sim->num_dances ? lo : sim->num_dances - 1;
+}
+
+static int compare_dances(const void *a, const void *b)
+{
+    return ((const WaggleDance *)a)->bee_id - ((const WaggleDance *)b)->bee_id;
+}
+
+void sort_dances(Simulation *sim)
+{
+    if (sim->num_dances > 0)
+        qsort(sim->dances, sim->num_dances, sizeof(WaggleDance), compare_dances);
+}
+
+void idle_bees_watch_dances(Simulation *sim)
+{
+    if (sim->num_dances == 0)
+        return;
+
+    BeeArrays *bees = &sim->bees;
+    StateBuckets *b = &sim->buckets;
+    int *idle = b->ids[IDLE];
+    int n[NUM_BEE_STATES] = {0};
+    n[IDLE] = b->count[IDLE];
+    int batch = sim_config.sync_step ? n[IDLE] : sim_config.dance_watch_batch;
+    int num_dances = sim->num_dances;
+    reserve_thread_contexts(sim);
+
+    // With sync_step (the default) the whole phase is one batch: every idle
+    // bee reads the table as this step's update left it, and recruits land
+    // only after the phase, so the outcome does not depend on the order of
+    // the bucket or on how the bees are split across ranks.
+    // Without it idle bees watch in batches of dance_watch_batch. The table
+    // is frozen within a batch, so followers recruited in a batch raise a
+    // dance's follower bonus only for the batches after it. Batches are a
+    // fixed size, so this does not depend on the thread count, but each MPI
+    // rank batches its own bucket.
+    // Each thread counts its recruits in its own array; the arrays are
+    // summed into the table after every batch, so no counter is shared.
+#pragma omp parallel
+    {
+        int team = team_size();
+        ThreadContext *ctx = thread_context(sim);
+        if (ctx->followers_capacity < num_dances)
+        {
+            ctx->followers_capacity = num_dances;
+            ctx->followers = (int *)realloc(ctx->followers, num_dances * sizeof(int));
+        }
+        memset(ctx->followers, 0, num_dances * sizeof(int));
+
+        for (int start = 0; start < n[IDLE]; start += batch)
+        {
+            int stop = start + batch < n[IDLE] ? start + batch : n[IDLE];
+
+#pragma omp single
+            build_dance_table(sim);
+
+#pragma omp for schedule(static)
+            for (int k = start; k < stop; k++)
+            {
+                int i = idle[k];
+                Rng rng = rng_stream(sim_config.seed, RNG_WATCH_DANCES, i, sim->timestep);
+
+                if (rng_float(&rng, 0, 1) < sim_config.decision_probability)
+                {
+                    int chosen_dance = choose_dance(sim, &rng);
+
+                    if (chosen_dance >= 0)
+                    {
+                        bees->following_dance[i] = chosen_dance;
+                        bees->state[i] = FOLLOWER;
+                        ctx->followers[chosen_dance]++;
+
+                        bees->target_x[i] = sim->dances[chosen_dance].flower_location.x;
+                        bees->target_y[i] = sim->dances[chosen_dance].flower_location.y;
+                    }
+                }
+            }
+
+#pragma omp for schedule(static)
+            for (int c = 0; c < num_dances; c++)
+            {
+                int recruits = 0;
+                for (int t = 0; t < team; t++)
+                {
+                    recruits += sim->threads[t]->followers[c];
+                    sim->threads[t]->followers[c] = 0;
+                }
+                sim->dances[c].followers += recruits;
+            }
+        }
+    }
+
+    // every dance is watched only in the step it was created, so its
+    // follower count is this step's recruits
+    for (int c = 0; c < sim->num_dances; c++)
+    {
+        bees->dance_followers[sim->dances[c].bee_id] += sim->dances[c].followers;
+    }
+
+    buckets_refresh(b, bees->state, n);
+}
+
+// Runs after move_bees; flight_dist is the distance before that move
+void follower_behavior(Simulation *sim, int i)
+{
+    BeeArrays *bees = &sim->bees;
+
+    if (bees->flight_dist[i] < FOLLOWER_ARRIVAL)
+    {
+        bees->state[i] = FORAGING;
+
+        Vector2D target = {bees->target_x[i], bees->target_y[i]};
+        int found = flower_grid_find(&sim->flower_grid, sim->flowers, target, 20.0f, -1);
+        if (found >= 0)
+        {
+            bees->target_flower[i] = found;
+        }
+
+        if (bees->target_flower[i] == -1)
+        {
+            bees->state[i] = RETURNING;
+        }
+    }
+
+    if (bees->energy[i] < sim_config.max_energy * 0.2f)
+    {
+        bees->state[i] = RETURNING;
+        bees->target_flower[i] = -1;
+    }
+}
+
+void foraging_behavior(Simulation *sim, int i, HarvestDemand *demand)
+{
+    BeeArrays *bees = &sim->bees;
+
+    demand->flower = bees->target_flower[i];
+    demand->bee = i;
+    demand->rank = 0;
+    demand->collected = 0.0f;
+
+    if (bees->target_flower[i] < 0)
+    {
+        bees->state[i] = IDLE;
+    }
+}
+
+// Serves up to capacity bees, smallest id first, while the nectar lasts.
+// Only the served bees have to be in order, so they are picked by selection:
+// a crowded flower costs capacity scans of its group rather than a sort.
+// The served demands end up first, in id order. The flower's regrowth is
+// settled here, and only if a bee takes nectar.
+static void serve_flower(Flower *flower, HarvestDemand *d, int m, int timestep)
+{
+    for (int k = 0; k < m; k++)
+    {
+        d[k].collected = 0.0f;
+    }
+
+    float nectar = flower_nectar(flower, timestep);
+    int served = 0;
+    while (served < m && served < flower->capacity && nectar > 0)
+    {
+        int first = served;
+        for (int k = served + 1; k < m; k++)
+        {
+            if (d[k].bee < d[first].bee)
+                first = k;
+        }
+        HarvestDemand next = d[first];
+        d[first] = d[served];
+
+        next.collected = fminf(10.0f, nectar);
+        nectar -= next.collected;
+        d[served++] = next;
+    }
+
+    if (served > 0)
+    {
+        flower->nectar_available = nectar;
+        flower->nectar_step = timestep;
+    }
+}
+
+static int compare_demands(const void *a, const void *b)
+{
+    const HarvestDemand *da = (const HarvestDemand *)a;
+    const HarvestDemand *db = (const HarvestDemand *)b;
+    return (da->flower > db->flower) - (da->flower < db->flower);
+}
+
+// Groups demands by flower, flowers ascending, and returns the number of
+// groups; group g is demands[start[g] .. start[g + 1]). A counting sort costs
+// O(num_flowers) however few demands there are, so a large, sparsely visited
+// field is sorted instead.
+static int group_demands(Simulation *sim, HarvestDemand *demands, int n)
+{
+    int num_flowers = sim_config.num_flowers;
+    sim->group_start = (int *)reserve_scratch(sim->group_start, &sim->group_start_capacity, n + 1, sizeof(int));
+    int *start = sim->group_start;
+    if ((long)n * 16 < num_flowers)
+    {
+        if (n > 0)
+            qsort(demands, n, sizeof(HarvestDemand), compare_demands);
+    }
+    else
+    {
+        if (!sim->flower_counts)
+            sim->flower_counts = (int *)malloc((num_flowers + 1) * sizeof(int));
+        sim->grouped = (HarvestDemand *)reserve_scratch(sim->grouped, &sim->grouped_capacity, n + 1,
+                                                        sizeof(HarvestDemand));
+        int *count = sim->flower_counts;
+        HarvestDemand *grouped = sim->grouped;
+        memset(count, 0, (num_flowers + 1) * sizeof(int));
+        for (int k = 0; k < n; k++)
+        {
+            count[demands[k].flower + 1]++;
+        }
+        for (int f = 0; f < num_flowers; f++)
+        {
+            count[f + 1] += count[f];
+        }
+        for (int k = 0; k < n; k++)
+        {
+            grouped[count[demands[k].flower]++] = demands[k];
+        }
+        memcpy(demands, grouped, n * sizeof(HarvestDemand));
+    }
+
+    int num_groups = 0;
+    for (int k = 0; k < n; k++)
+    {
+        if (k == 0 || demands[k].flower != demands[k - 1].flower)
+            start[num_groups++] = k;
+    }
+    start[num_groups] = n;
+    return num_groups;
+}
+
+double resolve_harvest(Simulation *sim, HarvestDemand *demands, int n)
+{
+    Flower *flowers = sim->flowers;
+    int timestep = sim->timestep;
+    int num_groups = group_demands(sim, demands, n);
+    const int *start = sim->group_start;
+
+    // flowers share nothing, so their groups resolve in parallel
+#pragma omp parallel for schedule(dynamic, 64)
+    for (int g = 0; g < num_groups; g++)
+    {
+        serve_flower(&flowers[demands[start[g]].flower], demands + start[g], start[g + 1] - start[g], timestep);
+    }
+
+    // a double holds the sum of these floats exactly, so the total does not
+    // depend on how demands are split across threads or ranks
+    double total = 0.0;
+    for (int k = 0; k < n; k++)
+    {
+        total += demands[k].collected;
+    }
+    return total;
+}
+
+static void harvest_outcome(BeeArrays *bees, int i, float collected)
+{
+    if (collected > 0)
+    {
+        bees->energy[i] = fminf(sim_config.max_energy, bees->energy[i] + collected * 0.5f);
+        bees->nectar_found[i] = collected;
+
+        // keeps target_flower: the bee dances for it back at the hive
+        bees->state[i] = RETURNING;
+        bees->following_dance[i] = -1;
+    }
+    else if (bees->following_dance[i] >= 0)
+    {
+        bees->state[i] = RETURNING;
+        bees->target_flower[i] = -1;
+        bees->following_dance[i] = -1;
+    }
+    else
+    {
+        bees->state[i] = SCOUT;
+        bees->target_flower[i] = -1;
+    }
+}
+
+void apply_harvest(Simulation *sim, const HarvestDemand *demands, int n)
+{
+    BeeArrays *bees = &sim->bees;
+    StateBuckets *b = &sim->buckets;
+
+    for (int k = 0; k < n; k++)
+    {
+        harvest_outcome(bees, demands[k].bee, demands[k].collected);
+    }
+
+    // the foragers' upkeep was held back until they knew their harvest
+    int scanned[NUM_BEE_STATES] = {0};
+    scanned[FORAGING] = sim->num_foragers;
+    bee_upkeep(sim, b->ids[FORAGING], sim->num_foragers);
+    buckets_refresh(b, bees->state, scanned);
+
+    sim->num_demands = 0;
+    sim->num_foragers = 0;
+}
+
+double harvest(Simulation *sim)
+{
+    double nectar = resolve_harvest(sim, sim->demands, sim->num_demands);
+    apply_harvest(sim, sim->demands, sim->num_demands);
+    return nectar;
+}
+
+void bee_upkeep(Simulation *sim, const int *ids, int n)
+{
+    int num_blocks = (n + KERNEL_BLOCK - 1) / KERNEL_BLOCK;
+#pragma omp for schedule(static)
+    for (int blk = 0; blk < num_blocks; blk++)
+    {
+        int start = blk * KERNEL_BLOCK;
+        int count = n - start < KERNEL_BLOCK ? n - start : KERNEL_BLOCK;
+        sim->kernels.upkeep(&sim->bees, ids + start, count);
+    }
+}
+
+// Steps, counting the coming one, until bee i does more than fly straight on
+// or count down its dance: 1 if it has to be stepped now. Flights keep their
+// direction and speed, so arrival and exhaustion follow from the distance and
+// the energy left, with the thresholds of returning_behavior,
+// follower_behavior and bee_upkeep.
+static int steps_to_event(const BeeArrays *bees, int i)
+{
+    double e = bees->energy[i];
+    double speed = sim_config.bee_speed;
+    double cost = sim_config.energy_cost;
+
+    // an exhausted bee keeps flying home, but rests as soon as it stops
+    double steps = 1;
+    if (bees->state[i] == DANCING)
+    {
+        steps = e > 0 ? bees->dance_timer[i] : 1;
+    }
+    else if (bees->state[i] == RETURNING)
+    {
+        // a bee faster than that could skip over the hive
+        double radius = sim_config.hive_radius;
+        if (speed > radius)
+            return 1;
+        double dx = bees->x[i] - HIVE_X;
+        double dy = bees->y[i] - HIVE_Y;
+        double len = sqrt(dx * dx + dy * dy);
+        steps = len < radius ? 1 : floor((len - radius) / speed) + 1;
+        // exhaustion makes it forget its flower
+        if (bees->target_flower[i] >= 0)
+            steps = e <= 0 ? 1 : (cost > 0 ? fmin(steps, ceil(e / cost)) : steps);
+    }
+    else if (bees->state[i] == FOLLOWER)
+    {
+        if (speed > 2 * FOLLOWER_ARRIVAL || e <= 0)
+            return 1;
+        double dx = bees->target_x[i] - bees->x[i];
+        double dy = bees->target_y[i] - bees->y[i];
+        double len = sqrt(dx * dx + dy * dy);
+        // flight_dist is the distance before the move
+        steps = len < FOLLOWER_ARRIVAL ? 1 : floor((len - FOLLOWER_ARRIVAL) / speed) + 2;
+        double low = sim_config.max_energy * 0.2f;
+        if (cost > 0)
+            steps = fmin(steps, fmin(e < low ? 1 : floor((e - low) / cost) + 1, ceil(e / cost)));
+    }
+    return steps < 1 ? 1 : (int)fmin(steps, MAX_PARKED_STEPS);
+}
+
+// Moves bees with steps ahead of them that need no decision from their
+// buckets to the calendar. They keep their state of this step (park_step)
+// and are not touched again until the step they wake at.
+static void park_bees(Simulation *sim)
+{
+    BeeArrays *bees = &sim->bees;
+    StateBuckets *b = &sim->buckets;
+    const int parkable[] = {RETURNING, DANCING, FOLLOWER};
+
+    int most = 0;
+    for (int p = 0; p < 3; p++)
+    {
+        most = b->count[parkable[p]] > most ? b->count[parkable[p]] : most;
+    }
+    sim->park_steps = (int *)reserve_scratch(sim->park_steps, &sim->park_steps_capacity, most + 1, sizeof(int));
+    int *steps = sim->park_steps;
+
+    for (int p = 0; p < 3; p++)
+    {
+        int s = parkable[p];
+        int *ids = b->ids[s];
+        int n = b->count[s];
+
+        // the predictions read every bee of the bucket and are independent,
+        // so they run in parallel; the bees are filed in bucket order
+#pragma omp parallel for schedule(static)
+        for (int k = 0; k < n; k++)
+        {
+            steps[k] = steps_to_event(bees, ids[k]);
+        }
+
+        int kept = 0;
+        for (int k = 0; k < n; k++)
+        {
+            if (steps[k] <= 1)
+            {
+                ids[kept++] = ids[k];
+                continue;
+            }
+
+            ParkedBee parked = {ids[k], sim->timestep, sim->timestep + steps[k] - 1};
+            calendar_add(&sim->calendar, &parked, s);
+        }
+        b->count[s] = kept;
+    }
+}
+
+Vector2D bee_position(const BeeArrays *bees, const ParkedBee *p, int timestep)
+{
+    int i = p->bee;
+    int s = bees->state[i];
+    Vector2D pos = {bees->x[i], bees->y[i]};
+    if (s == DANCING)
+        return pos;
+
+    // the velocity move_bees would have given it at park_step: position and
+    // target are frozen while parked, so it comes out the same every time
+    float dx = (s == RETURNING ? HIVE_X : bees->target_x[i]) - pos.x;
+    float dy = (s == RETURNING ? HIVE_Y : bees->target_y[i]) - pos.y;
+    float len = sqrtf(dx * dx + dy * dy);
+    float k = (float)(timestep - p->park_step);
+    pos.x += k * (dx / len * sim_config.bee_speed);
+    pos.y += k * (dy / len * sim_config.bee_speed);
+    return pos;
+}
+
+// Brings the bees that wake this step up to date and files them back
+static void wake_bees(Simulation *sim)
+{
+    BeeArrays *bees = &sim->bees;
+    int n;
+    const ParkedBee *woken = calendar_pop(&sim->calendar, bees->state, sim->timestep, &n);
+
+#pragma omp parallel for schedule(static)
+    for (int k = 0; k < n; k++)
+    {
+        int i = woken[k].bee;
+        int steps = sim->timestep - woken[k].park_step;
+        Vector2D pos = bee_position(bees, &woken[k], sim->timestep);
+        bees->x[i] = pos.x;
+        bees->y[i] = pos.y;
+        if (bees->state[i] == DANCING)
+            bees->dance_timer[i] -= steps;
+        else
+            bees->energy[i] -= (float)steps * sim_config.energy_cost;
+    }
+
+    for (int k = 0; k < n; k++)
+    {
+        buckets_add(&sim->buckets, bees->state, &woken[k].bee, 1);
+    }
+}
+
+void parked_positions(const Simulation *sim, float *x, float *y)
+{
+    const Calendar *c = &sim->calendar;
+    for (int d = 0; d < c->num_days; d++)
+    {
+        for (const CalendarChunk *chunk = c->first[d]; chunk; chunk = chunk->next)
+        {
+            for (int k = 0; k < chunk->count; k++)
+            {
+                const ParkedBee *p = &chunk->bees[k];
+                Vector2D pos = bee_position(&sim->bees, p, sim->timestep);
+                x[p->bee] = pos.x;
+                y[p->bee] = pos.y;
+            }
+        }
+    }
+}
+
+void update_bees(Simulation *sim)
+{
+    StateBuckets *b = &sim->buckets;
+    BeeArrays *bees = &sim->bees;
+
+    if (sim_config.events)
+    {
+        wake_bees(sim);
+        park_bees(sim);
+    }
+
+    // Membership is frozen for the whole update: a bee that changes state is
+    // handled by its old bucket this step and re-filed afterwards. IDLE bees
+    // have nothing to do until they watch a dance, and their energy is known
+    // to be positive, so they skip upkeep as well.
+    int n[NUM_BEE_STATES];
+    for (int s = 0; s < NUM_BEE_STATES; s++)
+    {
+        n[s] = b->count[s];
+    }
+    n[IDLE] = 0;
+    sim->num_demands = 0;
+    sim->num_foragers = n[FORAGING];
+
+    reserve_thread_contexts(sim);
+    reserve_demands(sim, n[FORAGING]);
+
+#pragma omp parallel
+    {
+        ThreadContext *ctx = thread_context(sim);
+        ctx->num_dances = 0;
+
+        move_bees(sim, b->ids[RETURNING], n[RETURNING], 1);
+        move_bees(sim, b->ids[FOLLOWER], n[FOLLOWER], 0);
+
+#pragma omp for schedule(static)
+        for (int k = 0; k < n[SCOUT]; k++)
+        {
+            scout_behavior(sim, b->ids[SCOUT][k]);
+        }
+
+#pragma omp for schedule(static)
+        for (int k = 0; k < n[RETURNING]; k++)
+        {
+            returning_behavior(sim, ctx, b->ids[RETURNING][k]);
+        }
+
+        // compact the thread buffers into sim->dances: offsets are a prefix
+        // sum of the buffer sizes, then every thread copies its own
+#pragma omp single
+        {
+            int total = 0;
+            for (int t = 0; t < team_size(); t++)
+            {
+                sim->threads[t]->dance_offset = total;
+                total += sim->threads[t]->num_dances;
+            }
+            reserve_dances(sim, total);
+            sim->num_dances = total;
+        }
+        if (ctx->num_dances > 0)
+            memcpy(sim->dances + ctx->dance_offset, ctx->dances, ctx->num_dances * sizeof(WaggleDance));
+
+#pragma omp for schedule(static)
+        for (int k = 0; k < n[DANCING]; k++)
+        {
+            dancing_behavior(bees, b->ids[DANCING][k]);
+        }
+
+#pragma omp for schedule(static)
+        for (int k = 0; k < n[FOLLOWER]; k++)
+        {
+            follower_behavior(sim, b->ids[FOLLOWER][k]);
+        }
+
+        // one demand slot per forager, so no two threads share a slot
+#pragma omp for schedule(static)
+        for (int k = 0; k < n[FORAGING]; k++)
+        {
+            foraging_behavior(sim, b->ids[FORAGING][k], &sim->demands[k]);
+        }
+
+        for (int s = 0; s < NUM_BEE_STATES; s++)
+        {
+            if (s != FORAGING)
+                bee_upkeep(sim, b->ids[s], n[s]);
+        }
+    }
+
+    // the merged order depends on how the bees were split across threads
+    sort_dances(sim);
+
+    // drop the slots of foragers that had no flower to go to
+    for (int k = 0; k < n[FORAGING]; k++)
+    {
+        if (sim->demands[k].flower >= 0)
+            sim->demands[sim->num_demands++] = sim->demands[k];
+    }
+
+    // foragers stay filed as they are until apply_harvest
+    n[FORAGING] = 0;
+    buckets_refresh(b, bees->state, n);
+}
+
+void bee_counts(const Simulation *sim, int *count)
+{
+    for (int s = 0; s < NUM_BEE_STATES; s++)
+    {
+        count[s] = sim->buckets.count[s] + sim->calendar.parked[s];
+    }
+}
+
+void print_statistics(Simulation *sim, const int *count)
+{
+    printf("Step %4d | Nectar: %7.2f | Scout: %3d | Idle: %3d | Dance: %3d | Follow: %3d | Forage: %3d | Return: %3d\n",
+           sim->timestep, sim->total_nectar_collected, count[SCOUT], count[IDLE], count[DANCING],
+           count[FOLLOWER], count[FORAGING], count[RETURNING]);
+}
+
+void save_results(Simulation *sim, const char *filename, const char *label)
+{
+    FILE *f = fopen(filename, "w");
+    if (!f)
+    {
+        printf("Error opening file %s\n", filename);
+        return;
+    }
+
+    fprintf(f, "# Bee Foraging Simulation Results (%s)\n", label);
+    fprintf(f, "# Total nectar collected: %.2f\n", sim->total_nectar_collected);
+    fprintf(f, "# Timesteps: %d\n\n", sim->timestep);
+
+    fprintf(f, "# Flower positions and remaining nectar:\n");
+    for (int i = 0; i < sim_config.num_flowers; i++)
+    {
+        fprintf(f, "Flower %d: (%.2f, %.2f) nectar=%.2f/%.2f\n",
+                i, sim->flowers[i].position.x, sim->flowers[i].position.y,
+                flower_nectar(&sim->flowers[i], sim->timestep), sim->flowers[i].nectar_total);
+    }
+
+    fclose(f);
+    printf("Results saved to %s\n", filename);
+}
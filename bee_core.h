@@ -0,0 +1,116 @@
+#ifndef BEE_CORE_H
+#define BEE_CORE_H
+#include "types.h"
+#include "rng.h"
+
+// Simulation engine shared by the seq, omp and mpi drivers.
+// Built twice: libbeecore.a (serial) and libbeecore_omp.a (-fopenmp), so the
+// same kernels run single-threaded or with OpenMP worksharing.
+
+float distance(Vector2D a, Vector2D b);
+
+// Nectar of the flower at the start of timestep (see Flower)
+static inline float flower_nectar(const Flower *f, int timestep)
+{
+    if (f->nectar_available >= f->nectar_total)
+        return f->nectar_available;
+    float regrown = f->nectar_available + f->regen_rate * (float)(timestep - f->nectar_step);
+    return regrown < f->nectar_total ? regrown : f->nectar_total;
+}
+Vector2D random_position(Rng *rng);
+
+// The world is cut into size vertical strips of equal width; rank r owns
+// the bees with x in [lo, hi) of strip r. The outer strips are open-ended.
+void strip_bounds(int rank, int size, float *lo, float *hi);
+int strip_owner(float x, int size);
+
+void alloc_bees(BeeArrays *bees, int num_bees);
+void free_bees(BeeArrays *bees);
+
+// The per-bee arrays that carry a bee from one step to the next: what
+// migrates between ranks and what a checkpoint stores. flight_dist is
+// step-local, so it is left out.
+#define NUM_BEE_FIELDS 11
+void bee_fields(BeeArrays *bees, char **ptr, int *elem_size);
+// The world comes from the --world file (world.h) or from rng.h streams keyed
+// on sim_config.seed and the bee or flower id, so every rank sees the same one.
+// init_bees fills in only the bees with x in [lo, hi) and adds them to
+// buckets; returns how many, or -1 if the world file is not sorted by x.
+int init_bees(BeeArrays *bees, int num_bees, float lo, float hi, StateBuckets *buckets);
+void init_flowers(Flower *flowers, int num_flowers);
+
+// Every rank keeps all flowers but only the bees in its own strip. Bee arrays
+// stay indexed by bee id and sized for the whole colony; a rank touches the
+// entries of the bees it has owned at some point. A parked bee stays with its rank until it wakes, wherever its
+// flight takes it. NULL if the world file does not fit or the flower grid
+// cannot be allocated.
+Simulation *create_simulation(int rank, int size);
+void destroy_simulation(Simulation *sim);
+
+// Kernels over a list of bee ids. Orphaned "omp for" loops: inside a
+// parallel region the list is split across the team in blocks, each handed
+// to sim->kernels, which gathers and scatters the bees (bee_kernels.h).
+// move_bees flies the bees one step to the hive or to their target;
+// bee_upkeep sends exhausted bees home and clamps positions to the world.
+void move_bees(Simulation *sim, const int *ids, int n, int to_hive);
+void bee_upkeep(Simulation *sim, const int *ids, int n);
+
+// Per-bee decisions; RETURNING and FOLLOWER expect move_bees to have run
+void scout_behavior(Simulation *sim, int i);
+void returning_behavior(Simulation *sim, ThreadContext *ctx, int i);
+void dancing_behavior(BeeArrays *bees, int i);
+void follower_behavior(Simulation *sim, int i);
+// Fills in the bee's HarvestDemand for its target flower; a bee without a
+// flower goes idle and gets a demand for flower -1, which is dropped
+void foraging_behavior(Simulation *sim, int i, HarvestDemand *demand);
+
+// Adds the dance to the calling thread's buffer in ctx
+void create_dance(Simulation *sim, ThreadContext *ctx, int i);
+float calculate_dance_attractiveness(WaggleDance *dance);
+// Running attractiveness totals over sim->dances; choose_dance picks from the
+// last table built by binary search
+void build_dance_table(Simulation *sim);
+int choose_dance(Simulation *sim, Rng *rng);
+// Orders sim->dances by bee id
+void sort_dances(Simulation *sim);
+// Makes room for n dances in sim->dances and sim->dance_prefix. Both grow
+// with the most dances a step has seen rather than with the colony.
+void reserve_dances(Simulation *sim, int n);
+
+// Bees draw from their own (id, timestep) streams, and sim->dances is left
+// sorted by bee id, so the outcome does not depend on the thread count.
+// Foragers only file demands here; harvest (or the MPI exchange around
+// resolve_harvest and apply_harvest) completes the update. With events the
+// update first wakes the bees due this step and parks the dancers and
+// flying bees that need no decision for a while (calendar.h).
+void update_bees(Simulation *sim);
+
+// Where the parked bee p is at the start of timestep
+Vector2D bee_position(const BeeArrays *bees, const ParkedBee *p, int timestep);
+// Writes the current position of every parked bee into x and y, by bee id
+void parked_positions(const Simulation *sim, float *x, float *y);
+
+// Serves demands flower by flower, each flower's in ascending bee id: at
+// most capacity bees per flower, each taking up to 10 nectar. Demands are
+// grouped by flower in place, served ones first, and get their collected
+// amount; returns the total. The result depends only on the set of demands,
+// never on the order they were filed in or which thread or rank filed them.
+// Only the demanded flowers are visited, and only the served ones written.
+// Resolves at sim->timestep against sim->flowers.
+double resolve_harvest(Simulation *sim, HarvestDemand *demands, int n);
+// Applies resolved demands to their foragers, then finishes the foragers'
+// upkeep and refiles them. Must be given every demand of this process.
+void apply_harvest(Simulation *sim, const HarvestDemand *demands, int n);
+// resolve_harvest + apply_harvest over sim->demands; returns the nectar
+double harvest(Simulation *sim);
+// Recruits are counted per dance and credited to the dancers afterwards
+void idle_bees_watch_dances(Simulation *sim);
+
+// This process's bees per state, parked ones included
+void bee_counts(const Simulation *sim, int *count);
+// count[s] is the number of bees in state s: bee_counts in seq/omp, summed
+// over all ranks in mpi
+void print_statistics(Simulation *sim, const int *count);
+void save_results(Simulation *sim, const char *filename, const char *label);
+
+#endif
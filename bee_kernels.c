@@ -0,0 +1,282 @@
+#include <math.h>
+#include "bee_kernels.h"
+#include "sim_config.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define HAVE_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+// Parameters in registers: stores to the bee arrays could otherwise alias
+// sim_config and force a reload every bee
+typedef struct
+{
+    float hive_x, hive_y;
+    float speed, cost;
+    float hive_radius, max_energy, world_size;
+} KernelParams;
+
+static KernelParams kernel_params(void)
+{
+    KernelParams p;
+    p.hive_x = HIVE_X;
+    p.hive_y = HIVE_Y;
+    p.speed = sim_config.bee_speed;
+    p.cost = sim_config.energy_cost;
+    p.hive_radius = sim_config.hive_radius;
+    p.max_energy = sim_config.max_energy;
+    p.world_size = sim_config.world_size;
+    return p;
+}
+
+static inline void move_one(BeeArrays *bees, int i, int to_hive, const KernelParams *p)
+{
+    float px = bees->x[i], py = bees->y[i];
+
+    float dx = (to_hive ? p->hive_x : bees->target_x[i]) - px;
+    float dy = (to_hive ? p->hive_y : bees->target_y[i]) - py;
+    float len = sqrtf(dx * dx + dy * dy);
+
+    // normalize(), then scale to the bee speed
+    float step_x = (len > 0.0001f ? dx / len : dx) * p->speed;
+    float step_y = (len > 0.0001f ? dy / len : dy) * p->speed;
+
+    bees->flight_dist[i] = len;
+    bees->x[i] = px + step_x;
+    bees->y[i] = py + step_y;
+    bees->energy[i] -= p->cost;
+}
+
+// Exhausted bees rest in the hive or head back to it; (px, py) is the
+// position before the clamp
+static inline void tire_one(BeeArrays *bees, int i, float px, float py, const KernelParams *p)
+{
+    float dx = px - p->hive_x;
+    float dy = py - p->hive_y;
+    if (sqrtf(dx * dx + dy * dy) < p->hive_radius)
+    {
+        bees->energy[i] = p->max_energy;
+        bees->state[i] = IDLE;
+    }
+    else
+    {
+        bees->state[i] = RETURNING;
+        bees->target_flower[i] = -1;
+    }
+}
+
+static inline void upkeep_one(BeeArrays *bees, int i, const KernelParams *p)
+{
+    float px = bees->x[i], py = bees->y[i];
+    if (bees->energy[i] <= 0)
+        tire_one(bees, i, px, py, p);
+
+    px = px < 0 ? 0 : px;
+    py = py < 0 ? 0 : py;
+    bees->x[i] = px > p->world_size ? p->world_size : px;
+    bees->y[i] = py > p->world_size ? p->world_size : py;
+}
+
+static void move_scalar(BeeArrays *bees, const int *ids, int n, int to_hive)
+{
+    KernelParams p = kernel_params();
+    for (int k = 0; k < n; k++)
+    {
+        move_one(bees, ids[k], to_hive, &p);
+    }
+}
+
+static void upkeep_scalar(BeeArrays *bees, const int *ids, int n)
+{
+    KernelParams p = kernel_params();
+    for (int k = 0; k < n; k++)
+    {
+        upkeep_one(bees, ids[k], &p);
+    }
+}
+
+#ifdef HAVE_X86_KERNELS
+// Neither target enables FMA, and the Makefile builds with
+// -ffp-contract=off; sqrt and div are correctly rounded and the selects are
+// blends, so every lane computes exactly what move_one and upkeep_one do.
+// The ids of one call are distinct, so scattered lanes never collide.
+
+__attribute__((target("avx2"))) static void move_avx2(BeeArrays *bees, const int *ids, int n, int to_hive)
+{
+    KernelParams p = kernel_params();
+    __m256 hive_x = _mm256_set1_ps(p.hive_x);
+    __m256 hive_y = _mm256_set1_ps(p.hive_y);
+    __m256 speed = _mm256_set1_ps(p.speed);
+    __m256 cost = _mm256_set1_ps(p.cost);
+    __m256 near = _mm256_set1_ps(0.0001f);
+
+    int k = 0;
+    for (; k + 8 <= n; k += 8)
+    {
+        __m256i vi = _mm256_loadu_si256((const __m256i *)(ids + k));
+        __m256 px = _mm256_i32gather_ps(bees->x, vi, 4);
+        __m256 py = _mm256_i32gather_ps(bees->y, vi, 4);
+        __m256 tx = to_hive ? hive_x : _mm256_i32gather_ps(bees->target_x, vi, 4);
+        __m256 ty = to_hive ? hive_y : _mm256_i32gather_ps(bees->target_y, vi, 4);
+
+        __m256 dx = _mm256_sub_ps(tx, px);
+        __m256 dy = _mm256_sub_ps(ty, py);
+        __m256 len = _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)));
+        __m256 far = _mm256_cmp_ps(len, near, _CMP_GT_OQ);
+        __m256 step_x = _mm256_mul_ps(_mm256_blendv_ps(dx, _mm256_div_ps(dx, len), far), speed);
+        __m256 step_y = _mm256_mul_ps(_mm256_blendv_ps(dy, _mm256_div_ps(dy, len), far), speed);
+
+        // AVX2 has no scatter
+        float out_x[8], out_y[8], out_len[8], out_energy[8];
+        _mm256_storeu_ps(out_x, _mm256_add_ps(px, step_x));
+        _mm256_storeu_ps(out_y, _mm256_add_ps(py, step_y));
+        _mm256_storeu_ps(out_len, len);
+        _mm256_storeu_ps(out_energy, _mm256_sub_ps(_mm256_i32gather_ps(bees->energy, vi, 4), cost));
+        for (int j = 0; j < 8; j++)
+        {
+            int i = ids[k + j];
+            bees->flight_dist[i] = out_len[j];
+            bees->x[i] = out_x[j];
+            bees->y[i] = out_y[j];
+            bees->energy[i] = out_energy[j];
+        }
+    }
+
+    for (; k < n; k++)
+    {
+        move_one(bees, ids[k], to_hive, &p);
+    }
+}
+
+__attribute__((target("avx2"))) static void upkeep_avx2(BeeArrays *bees, const int *ids, int n)
+{
+    KernelParams p = kernel_params();
+    __m256 zero = _mm256_setzero_ps();
+    __m256 world_size = _mm256_set1_ps(p.world_size);
+
+    int k = 0;
+    for (; k + 8 <= n; k += 8)
+    {
+        __m256i vi = _mm256_loadu_si256((const __m256i *)(ids + k));
+        __m256 px = _mm256_i32gather_ps(bees->x, vi, 4);
+        __m256 py = _mm256_i32gather_ps(bees->y, vi, 4);
+        __m256 energy = _mm256_i32gather_ps(bees->energy, vi, 4);
+
+        // few bees run out in a step, so they take the scalar path
+        int tired = _mm256_movemask_ps(_mm256_cmp_ps(energy, zero, _CMP_LE_OQ));
+        for (; tired; tired &= tired - 1)
+        {
+            int i = ids[k + __builtin_ctz(tired)];
+            tire_one(bees, i, bees->x[i], bees->y[i], &p);
+        }
+
+        px = _mm256_blendv_ps(px, zero, _mm256_cmp_ps(px, zero, _CMP_LT_OQ));
+        py = _mm256_blendv_ps(py, zero, _mm256_cmp_ps(py, zero, _CMP_LT_OQ));
+        px = _mm256_blendv_ps(px, world_size, _mm256_cmp_ps(px, world_size, _CMP_GT_OQ));
+        py = _mm256_blendv_ps(py, world_size, _mm256_cmp_ps(py, world_size, _CMP_GT_OQ));
+
+        float out_x[8], out_y[8];
+        _mm256_storeu_ps(out_x, px);
+        _mm256_storeu_ps(out_y, py);
+        for (int j = 0; j < 8; j++)
+        {
+            bees->x[ids[k + j]] = out_x[j];
+            bees->y[ids[k + j]] = out_y[j];
+        }
+    }
+
+    for (; k < n; k++)
+    {
+        upkeep_one(bees, ids[k], &p);
+    }
+}
+
+__attribute__((target("avx512f"))) static void move_avx512(BeeArrays *bees, const int *ids, int n, int to_hive)
+{
+    KernelParams p = kernel_params();
+    __m512 hive_x = _mm512_set1_ps(p.hive_x);
+    __m512 hive_y = _mm512_set1_ps(p.hive_y);
+    __m512 speed = _mm512_set1_ps(p.speed);
+    __m512 cost = _mm512_set1_ps(p.cost);
+    __m512 near = _mm512_set1_ps(0.0001f);
+    __m512 zero = _mm512_setzero_ps();
+
+    for (int k = 0; k < n; k += 16)
+    {
+        __mmask16 live = n - k >= 16 ? 0xFFFF : (__mmask16)((1u << (n - k)) - 1);
+        __m512i vi = _mm512_maskz_loadu_epi32(live, ids + k);
+        __m512 px = _mm512_mask_i32gather_ps(zero, live, vi, bees->x, 4);
+        __m512 py = _mm512_mask_i32gather_ps(zero, live, vi, bees->y, 4);
+        __m512 tx = to_hive ? hive_x : _mm512_mask_i32gather_ps(zero, live, vi, bees->target_x, 4);
+        __m512 ty = to_hive ? hive_y : _mm512_mask_i32gather_ps(zero, live, vi, bees->target_y, 4);
+
+        __m512 dx = _mm512_sub_ps(tx, px);
+        __m512 dy = _mm512_sub_ps(ty, py);
+        __m512 len = _mm512_sqrt_ps(_mm512_add_ps(_mm512_mul_ps(dx, dx), _mm512_mul_ps(dy, dy)));
+        __mmask16 far = _mm512_cmp_ps_mask(len, near, _CMP_GT_OQ);
+        __m512 step_x = _mm512_mul_ps(_mm512_mask_div_ps(dx, far, dx, len), speed);
+        __m512 step_y = _mm512_mul_ps(_mm512_mask_div_ps(dy, far, dy, len), speed);
+        __m512 energy = _mm512_sub_ps(_mm512_mask_i32gather_ps(zero, live, vi, bees->energy, 4), cost);
+
+        _mm512_mask_i32scatter_ps(bees->flight_dist, live, vi, len, 4);
+        _mm512_mask_i32scatter_ps(bees->x, live, vi, _mm512_add_ps(px, step_x), 4);
+        _mm512_mask_i32scatter_ps(bees->y, live, vi, _mm512_add_ps(py, step_y), 4);
+        _mm512_mask_i32scatter_ps(bees->energy, live, vi, energy, 4);
+    }
+}
+
+__attribute__((target("avx512f"))) static void upkeep_avx512(BeeArrays *bees, const int *ids, int n)
+{
+    KernelParams p = kernel_params();
+    __m512 zero = _mm512_setzero_ps();
+    __m512 world_size = _mm512_set1_ps(p.world_size);
+
+    for (int k = 0; k < n; k += 16)
+    {
+        __mmask16 live = n - k >= 16 ? 0xFFFF : (__mmask16)((1u << (n - k)) - 1);
+        __m512i vi = _mm512_maskz_loadu_epi32(live, ids + k);
+        __m512 px = _mm512_mask_i32gather_ps(zero, live, vi, bees->x, 4);
+        __m512 py = _mm512_mask_i32gather_ps(zero, live, vi, bees->y, 4);
+        __m512 energy = _mm512_mask_i32gather_ps(zero, live, vi, bees->energy, 4);
+
+        unsigned tired = _mm512_mask_cmp_ps_mask(live, energy, zero, _CMP_LE_OQ);
+        for (; tired; tired &= tired - 1)
+        {
+            int i = ids[k + __builtin_ctz(tired)];
+            tire_one(bees, i, bees->x[i], bees->y[i], &p);
+        }
+
+        px = _mm512_mask_mov_ps(px, _mm512_cmp_ps_mask(px, zero, _CMP_LT_OQ), zero);
+        py = _mm512_mask_mov_ps(py, _mm512_cmp_ps_mask(py, zero, _CMP_LT_OQ), zero);
+        px = _mm512_mask_mov_ps(px, _mm512_cmp_ps_mask(px, world_size, _CMP_GT_OQ), world_size);
+        py = _mm512_mask_mov_ps(py, _mm512_cmp_ps_mask(py, world_size, _CMP_GT_OQ), world_size);
+
+        _mm512_mask_i32scatter_ps(bees->x, live, vi, px, 4);
+        _mm512_mask_i32scatter_ps(bees->y, live, vi, py, 4);
+    }
+}
+#endif
+
+BeeKernels bee_kernels_select(void)
+{
+    BeeKernels k = {move_scalar, upkeep_scalar, "scalar"};
+    int width = run_config.simd_width;
+#ifdef HAVE_X86_KERNELS
+    __builtin_cpu_init();
+    if ((width == 0 || width >= 16) && __builtin_cpu_supports("avx512f"))
+    {
+        k.move = move_avx512;
+        k.upkeep = upkeep_avx512;
+        k.name = "avx512";
+    }
+    else if ((width == 0 || width >= 8) && __builtin_cpu_supports("avx2"))
+    {
+        k.move = move_avx2;
+        k.upkeep = upkeep_avx2;
+        k.name = "avx2";
+    }
+#else
+    (void)width;
+#endif
+    return k;
+}
@@ -0,0 +1,14 @@
+#ifndef BEE_KERNELS_H
+#define BEE_KERNELS_H
+#include "types.h"
+
+// Flight and upkeep kernels over a list of distinct bee ids (see BeeKernels).
+// The AVX2 and AVX-512 kernels gather 8 and 16 bees per instruction and
+// scatter the results back; all kernels round the same way, so they give the
+// same bees as the scalar one, bit for bit.
+
+// Widest kernels the CPU supports, at most run_config.simd_width lanes
+// (0 = no limit, 1 = scalar)
+BeeKernels bee_kernels_select(void);
+
+#endif
@@ -0,0 +1,190 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
+#include "bench.h"
+#include "sim_config.h"
+
+#define STEP_NAME "step"
+
+double bench_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+double bench_peak_memory(void)
+{
+    struct rusage ru;
+    if (getrusage(RUSAGE_SELF, &ru) != 0)
+        return 0.0;
+    return ru.ru_maxrss / 1024.0; // kilobytes on Linux
+}
+
+void bench_init(Bench *b, const char **phase_names, int num_phases, int num_reps, int steps_per_rep)
+{
+    if (num_phases > BENCH_MAX_PHASES - 1)
+        num_phases = BENCH_MAX_PHASES - 1;
+
+    b->num_phases = num_phases;
+    for (int p = 0; p < num_phases; p++)
+    {
+        b->phase_names[p] = phase_names[p];
+    }
+    b->phase_names[num_phases] = STEP_NAME;
+
+    b->num_reps = num_reps;
+    b->steps_per_rep = steps_per_rep;
+    b->num_steps = 0;
+    b->samples = (double *)calloc((size_t)(num_phases + 1) * num_reps * steps_per_rep + 1, sizeof(double));
+    b->step_start = b->mark = 0.0;
+    b->peak_memory_mb = 0.0;
+}
+
+void bench_free(Bench *b)
+{
+    free(b->samples);
+    b->samples = NULL;
+}
+
+double *bench_samples(Bench *b, int phase)
+{
+    return b->samples + (size_t)phase * b->num_reps * b->steps_per_rep;
+}
+
+void bench_step_begin(Bench *b)
+{
+    if (!b)
+        return;
+    b->step_start = b->mark = bench_now();
+}
+
+void bench_lap(Bench *b, int phase)
+{
+    if (!b)
+        return;
+    double now = bench_now();
+    bench_samples(b, phase)[b->num_steps] += now - b->mark;
+    b->mark = now;
+}
+
+void bench_step_end(Bench *b)
+{
+    if (!b)
+        return;
+    if (b->num_steps >= b->num_reps * b->steps_per_rep)
+        return;
+    bench_samples(b, b->num_phases)[b->num_steps] = bench_now() - b->step_start;
+    b->num_steps++;
+}
+
+static int compare_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+typedef struct
+{
+    double min, median, p99, mean, max;
+} Summary;
+
+// Nearest-rank percentiles over n values (sorted in place)
+static Summary summarize(double *v, int n)
+{
+    Summary s = {0, 0, 0, 0, 0};
+    if (n == 0)
+        return s;
+
+    qsort(v, n, sizeof(double), compare_double);
+    double sum = 0.0;
+    for (int i = 0; i < n; i++)
+    {
+        sum += v[i];
+    }
+
+    int p99 = (int)((99L * n + 99) / 100) - 1;
+    s.min = v[0];
+    s.median = n % 2 ? v[n / 2] : 0.5 * (v[n / 2 - 1] + v[n / 2]);
+    s.p99 = v[p99 < 0 ? 0 : p99];
+    s.mean = sum / n;
+    s.max = v[n - 1];
+    return s;
+}
+
+void bench_report(Bench *b, const char *target, int workers, int warmup_steps, const char *path)
+{
+    int n = b->num_steps;
+    int reps = b->steps_per_rep > 0 ? n / b->steps_per_rep : 0;
+    double *sorted = (double *)malloc(((size_t)n + 1) * sizeof(double));
+
+    // throughput of each full repetition, from the summed step times
+    double *step = bench_samples(b, b->num_phases);
+    double *rates = (double *)malloc(((size_t)reps + 1) * sizeof(double));
+    for (int r = 0; r < reps; r++)
+    {
+        double elapsed = 0.0;
+        for (int t = 0; t < b->steps_per_rep; t++)
+        {
+            elapsed += step[(size_t)r * b->steps_per_rep + t];
+        }
+        rates[r] = elapsed > 0.0 ? b->steps_per_rep / elapsed : 0.0;
+    }
+    Summary rate = summarize(rates, reps);
+    double peak_mb = b->peak_memory_mb > 0.0 ? b->peak_memory_mb : bench_peak_memory();
+
+    FILE *f = fopen(path, "w");
+    if (!f)
+    {
+        printf("Error opening file %s\n", path);
+    }
+    else
+    {
+        fprintf(f, "{\n");
+        fprintf(f, "  \"target\": \"%s\",\n", target);
+        fprintf(f, "  \"workers\": %d,\n", workers);
+        fprintf(f, "  \"config\": ");
+        config_print_json(f);
+        fprintf(f, ",\n");
+        fprintf(f, "  \"repetitions\": %d,\n", reps);
+        fprintf(f, "  \"warmup_steps\": %d,\n", warmup_steps);
+        fprintf(f, "  \"steps_per_repetition\": %d,\n", b->steps_per_rep);
+        fprintf(f, "  \"steps_per_sec\": {\"min\": %.3f, \"median\": %.3f, \"max\": %.3f},\n",
+                rate.min, rate.median, rate.max);
+        fprintf(f, "  \"peak_memory_mb\": %.1f,\n", peak_mb);
+        fprintf(f, "  \"phases_ms\": {\n");
+    }
+
+    printf("\n=== Benchmark (%s, %d workers, %d x %d steps, %d warmup) ===\n",
+           target, workers, reps, b->steps_per_rep, warmup_steps);
+    printf("%-16s %10s %10s %10s %10s\n", "phase [ms]", "min", "median", "p99", "mean");
+
+    for (int p = 0; p <= b->num_phases; p++)
+    {
+        memcpy(sorted, bench_samples(b, p), (size_t)n * sizeof(double));
+        Summary s = summarize(sorted, n);
+
+        printf("%-16s %10.4f %10.4f %10.4f %10.4f\n",
+               b->phase_names[p], s.min * 1e3, s.median * 1e3, s.p99 * 1e3, s.mean * 1e3);
+        if (f)
+        {
+            fprintf(f, "    \"%s\": {\"min\": %.6f, \"median\": %.6f, \"p99\": %.6f, \"mean\": %.6f, \"max\": %.6f}%s\n",
+                    b->phase_names[p], s.min * 1e3, s.median * 1e3, s.p99 * 1e3, s.mean * 1e3, s.max * 1e3,
+                    p < b->num_phases ? "," : "");
+        }
+    }
+    printf("Steps/sec: min %.2f | median %.2f | max %.2f\n", rate.min, rate.median, rate.max);
+    printf("Peak memory: %.0f MB\n", peak_mb);
+
+    if (f)
+    {
+        fprintf(f, "  }\n}\n");
+        fclose(f);
+        printf("Benchmark saved to %s\n", path);
+    }
+
+    free(sorted);
+    free(rates);
+}
@@ -0,0 +1,47 @@
+#ifndef BENCH_H
+#define BENCH_H
+#include <stdio.h>
+
+// Per-phase step timers for the benchmark mode (--bench_repeats=N).
+// A driver brackets each timed step with bench_step_begin/bench_step_end and
+// calls bench_lap after every phase; laps of the same phase within one step
+// add up. All calls are no-ops on a NULL Bench, so the normal run path just
+// passes NULL.
+
+#define BENCH_MAX_PHASES 16
+
+typedef struct
+{
+    int num_phases; // named phases, plus the whole step in slot num_phases
+    const char *phase_names[BENCH_MAX_PHASES];
+
+    int steps_per_rep;
+    int num_reps;
+    int num_steps;          // steps recorded so far
+    double *samples;        // (num_phases + 1) x num_reps * steps_per_rep, seconds
+    double step_start, mark;
+    double peak_memory_mb; // 0 = this process's, see bench_report
+} Bench;
+
+double bench_now(void);
+// Peak resident memory of this process so far, in MB
+double bench_peak_memory(void);
+
+void bench_init(Bench *b, const char **phase_names, int num_phases, int num_reps, int steps_per_rep);
+void bench_free(Bench *b);
+
+void bench_step_begin(Bench *b);
+void bench_lap(Bench *b, int phase);
+void bench_step_end(Bench *b);
+
+// Samples of one phase (num_phases is the whole step), one per recorded step.
+// MPI drivers reduce these across ranks before reporting.
+double *bench_samples(Bench *b, int phase);
+
+// Prints a summary table and writes the JSON report to path.
+// target and workers describe the run (e.g. "omp", 4 threads). The peak
+// memory reported is peak_memory_mb if the driver set it (MPI sums it over
+// the ranks), else bench_peak_memory().
+void bench_report(Bench *b, const char *target, int workers, int warmup_steps, const char *path);
+
+#endif
@@ -0,0 +1,144 @@
+#include <stdlib.h>
+#include "calendar.h"
+
+void calendar_init(Calendar *c, int num_days)
+{
+    c->num_days = num_days;
+    c->first = (CalendarChunk **)calloc(num_days, sizeof(CalendarChunk *));
+    c->last = (CalendarChunk **)calloc(num_days, sizeof(CalendarChunk *));
+    c->count = (int *)calloc(num_days, sizeof(int));
+    c->spare = NULL;
+    c->due = NULL;
+    c->due_capacity = 0;
+    for (int s = 0; s < NUM_BEE_STATES; s++)
+    {
+        c->parked[s] = 0;
+    }
+}
+
+static void free_chunks(CalendarChunk *chunk)
+{
+    while (chunk)
+    {
+        CalendarChunk *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+}
+
+void calendar_free(Calendar *c)
+{
+    for (int d = 0; d < c->num_days; d++)
+    {
+        free_chunks(c->first[d]);
+    }
+    free_chunks(c->spare);
+    free(c->first);
+    free(c->last);
+    free(c->count);
+    free(c->due);
+    c->first = NULL;
+    c->last = NULL;
+    c->count = NULL;
+    c->spare = NULL;
+    c->due = NULL;
+    c->num_days = 0;
+}
+
+int calendar_total(const Calendar *c)
+{
+    int total = 0;
+    for (int s = 0; s < NUM_BEE_STATES; s++)
+    {
+        total += c->parked[s];
+    }
+    return total;
+}
+
+void calendar_add(Calendar *c, const ParkedBee *p, int state)
+{
+    int d = p->wake_step & (c->num_days - 1);
+    CalendarChunk *chunk = c->last[d];
+    if (!chunk || chunk->count == CALENDAR_CHUNK)
+    {
+        CalendarChunk *fresh = c->spare;
+        if (fresh)
+            c->spare = fresh->next;
+        else
+            fresh = (CalendarChunk *)malloc(sizeof(CalendarChunk));
+        fresh->next = NULL;
+        fresh->count = 0;
+        if (chunk)
+            chunk->next = fresh;
+        else
+            c->first[d] = fresh;
+        c->last[d] = chunk = fresh;
+    }
+    chunk->bees[chunk->count++] = *p;
+    c->count[d]++;
+    c->parked[state]++;
+}
+
+const ParkedBee *calendar_pop(Calendar *c, const unsigned char *state, int timestep, int *n)
+{
+    int d = timestep & (c->num_days - 1);
+    if (c->due_capacity < c->count[d])
+    {
+        c->due_capacity = c->count[d];
+        c->due = (ParkedBee *)realloc(c->due, (size_t)c->due_capacity * sizeof(ParkedBee));
+    }
+
+    // later years stay in the day, in order: they are packed to the front of
+    // the chunk list (the write never passes the read) and the chunks left
+    // empty go back to the spares, so the calendar holds about as many chunks
+    // as it has bees without ever reallocating a day
+    CalendarChunk *out = c->first[d];
+    int kept = 0, due = 0, out_k = 0;
+    for (CalendarChunk *chunk = c->first[d]; chunk; chunk = chunk->next)
+    {
+        for (int k = 0; k < chunk->count; k++)
+        {
+            const ParkedBee *p = &chunk->bees[k];
+            if (p->wake_step == timestep)
+            {
+                c->due[due++] = *p;
+                c->parked[state[p->bee]]--;
+                continue;
+            }
+            if (out_k == CALENDAR_CHUNK)
+            {
+                out = out->next;
+                out_k = 0;
+            }
+            out->bees[out_k++] = *p;
+            kept++;
+        }
+    }
+    c->count[d] = kept;
+
+    if (out)
+    {
+        CalendarChunk *empty = out->next;
+        if (kept == 0)
+        {
+            empty = out;
+            c->first[d] = c->last[d] = NULL;
+        }
+        else
+        {
+            out->count = out_k;
+            out->next = NULL;
+            c->last[d] = out;
+        }
+        while (empty)
+        {
+            CalendarChunk *next = empty->next;
+            empty->next = c->spare;
+            c->spare = empty;
+            empty = next;
+        }
+    }
+
+    *n = due;
+    return c->due;
+}
@@ -0,0 +1,25 @@
+#ifndef CALENDAR_H
+#define CALENDAR_H
+#include "types.h"
+
+#define CALENDAR_DAYS 1024 // a power of two
+
+// Calendar queue of parked bees. A bee whose next steps are known in advance
+// (a dance countdown or a straight flight) leaves its state bucket until the
+// step it has to decide something again, its wake step. Day d holds the bees
+// that wake at a step t with t % num_days == d; a bee due in a later year
+// waits in its day until then. Days keep their bees in parking order, in a
+// list of chunks (first[d] to last[d]) that are recycled through the spare
+// list instead of freed, so parking allocates only while the calendar grows.
+void calendar_init(Calendar *c, int num_days);
+void calendar_free(Calendar *c);
+int calendar_total(const Calendar *c);
+
+// Parks p->bee, whose state is state, until p->wake_step. The park and wake
+// steps live only here, so the bee arrays carry nothing for parking.
+void calendar_add(Calendar *c, const ParkedBee *p, int state);
+// Takes the bees that wake at timestep off the calendar and returns them in
+// parking order; they stay valid until the next call. Sets *n to how many.
+const ParkedBee *calendar_pop(Calendar *c, const unsigned char *state, int timestep, int *n);
+
+#endif
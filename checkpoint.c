@@ -0,0 +1,259 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include "checkpoint.h"
+#include "bee_core.h"
+#include "state_buckets.h"
+#include "calendar.h"
+#include "sim_config.h"
+#include "flower_grid.h"
+#include "world.h"
+
+_Static_assert(sizeof(CheckpointHeader) == 96, "CheckpointHeader layout changed");
+
+// path for a single process, path.<rank> with several
+static void rank_file(char *buf, size_t len, const char *path, int rank, int size)
+{
+    if (size == 1)
+        snprintf(buf, len, "%s", path);
+    else
+        snprintf(buf, len, "%s.%d", path, rank);
+}
+
+int checkpoint_save(Simulation *sim, const char *path, int rank, int size)
+{
+    char file[1024], tmp[1040];
+    rank_file(file, sizeof(file), path, rank, size);
+    snprintf(tmp, sizeof(tmp), "%s.tmp", file);
+
+    StateBuckets *b = &sim->buckets;
+    Calendar *c = &sim->calendar;
+    CheckpointHeader h;
+    memset(&h, 0, sizeof(h));
+    strcpy(h.magic, CHECKPOINT_MAGIC);
+    h.version = CHECKPOINT_VERSION;
+    h.header_size = sizeof(CheckpointHeader);
+    h.config_size = sizeof(SimConfig);
+    h.rank = rank;
+    h.num_ranks = size;
+    h.timestep = sim->timestep;
+    h.num_bees = sim_config.num_bees;
+    h.num_flowers = sim_config.num_flowers;
+    h.total_nectar_collected = sim->total_nectar_collected;
+    h.world = world_identity();
+
+    // the buckets and the calendar days in order, so the restarted run
+    // visits and wakes bees the same way
+    h.num_parked = calendar_total(c);
+    int n = buckets_total(b) + h.num_parked;
+    int *ids = (int *)malloc(((size_t)n + 1) * sizeof(int));
+    int *steps = (int *)malloc((2 * (size_t)h.num_parked + 1) * sizeof(int));
+    int filled = 0, parked = 0;
+    for (int s = 0; s < NUM_BEE_STATES; s++)
+    {
+        h.bucket_count[s] = b->count[s];
+        if (b->count[s] > 0)
+            memcpy(ids + filled, b->ids[s], (size_t)b->count[s] * sizeof(int));
+        filled += b->count[s];
+    }
+    for (int d = 0; d < c->num_days; d++)
+    {
+        for (const CalendarChunk *chunk = c->first[d]; chunk; chunk = chunk->next)
+        {
+            for (int k = 0; k < chunk->count; k++, parked++)
+            {
+                ids[filled++] = chunk->bees[k].bee;
+                steps[parked] = chunk->bees[k].park_step;
+                steps[h.num_parked + parked] = chunk->bees[k].wake_step;
+            }
+        }
+    }
+
+    FILE *f = fopen(tmp, "wb");
+    if (!f)
+    {
+        printf("Error: cannot create %s: %s\n", tmp, strerror(errno));
+        free(ids);
+        free(steps);
+        return -1;
+    }
+
+    int ok = fwrite(&h, sizeof(h), 1, f) == 1 && fwrite(&sim_config, sizeof(SimConfig), 1, f) == 1 &&
+             fwrite(ids, sizeof(int), n, f) == (size_t)n;
+
+    char *field[NUM_BEE_FIELDS];
+    int elem_size[NUM_BEE_FIELDS];
+    bee_fields(&sim->bees, field, elem_size);
+    char *values = (char *)malloc((size_t)n * sizeof(float) + 1);
+    for (int k = 0; ok && k < NUM_BEE_FIELDS; k++)
+    {
+        for (int j = 0; j < n; j++)
+        {
+            memcpy(values + (size_t)j * elem_size[k], field[k] + (size_t)ids[j] * elem_size[k], elem_size[k]);
+        }
+        ok = fwrite(values, elem_size[k], n, f) == (size_t)n;
+    }
+    free(values);
+    free(ids);
+
+    ok = ok && fwrite(steps, sizeof(int), 2 * (size_t)h.num_parked, f) == 2 * (size_t)h.num_parked;
+    free(steps);
+    ok = ok && fwrite(sim->flowers, sizeof(Flower), sim_config.num_flowers, f) == (size_t)sim_config.num_flowers;
+    ok = ok && fflush(f) == 0 && fsync(fileno(f)) == 0;
+    ok = fclose(f) == 0 && ok;
+    ok = ok && rename(tmp, file) == 0;
+    if (!ok)
+    {
+        printf("Error: cannot write %s: %s\n", file, strerror(errno));
+        remove(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+static int load_error(FILE *f, int *ids, const char *file, const char *problem)
+{
+    printf("Error: %s %s\n", file, problem);
+    free(ids);
+    fclose(f);
+    return -1;
+}
+
+int checkpoint_load(Simulation *sim, const char *path, int rank, int size)
+{
+    char file[1024];
+    rank_file(file, sizeof(file), path, rank, size);
+
+    FILE *f = fopen(file, "rb");
+    if (!f)
+    {
+        printf("Error: cannot open %s: %s\n", file, strerror(errno));
+        return -1;
+    }
+
+    CheckpointHeader h;
+    SimConfig saved;
+    if (fread(&h, sizeof(h), 1, f) != 1 || memcmp(h.magic, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC)) != 0 ||
+        h.version != CHECKPOINT_VERSION || h.header_size != sizeof(CheckpointHeader) ||
+        h.config_size != sizeof(SimConfig) || fread(&saved, sizeof(saved), 1, f) != 1)
+        return load_error(f, NULL, file, "is not a checkpoint of this version");
+    if (h.rank != rank || h.num_ranks != size)
+        return load_error(f, NULL, file, "was written by another number of ranks");
+    if (h.world != world_identity())
+    {
+        const char *problem = h.world == 0              ? "was written from a generated world"
+                              : world_identity() == 0 ? "was written from a --world file"
+                                                      : "was written from another --world file";
+        return load_error(f, NULL, file, problem);
+    }
+
+    const char *key = config_mismatch(&saved);
+    if (key)
+    {
+        printf("Error: %s was written with a different %s\n", file, key);
+        fclose(f);
+        return -1;
+    }
+
+    int n = 0;
+    for (int s = 0; s < NUM_BEE_STATES; s++)
+    {
+        if (h.bucket_count[s] < 0 || h.bucket_count[s] > sim_config.num_bees - n)
+            return load_error(f, NULL, file, "is corrupt (bucket sizes)");
+        n += h.bucket_count[s];
+    }
+    if (h.num_parked < 0 || h.num_parked > sim_config.num_bees - n)
+        return load_error(f, NULL, file, "is corrupt (bucket sizes)");
+    int num_active = n;
+    n += h.num_parked;
+
+    int *ids = (int *)malloc(((size_t)n + 1) * sizeof(int));
+    if (fread(ids, sizeof(int), n, f) != (size_t)n)
+        return load_error(f, ids, file, "is truncated");
+    for (int j = 0; j < n; j++)
+    {
+        if (ids[j] < 0 || ids[j] >= sim_config.num_bees)
+            return load_error(f, ids, file, "is corrupt (bee ids)");
+    }
+
+    char *field[NUM_BEE_FIELDS];
+    int elem_size[NUM_BEE_FIELDS];
+    bee_fields(&sim->bees, field, elem_size);
+    char *values = (char *)malloc((size_t)n * sizeof(float) + 1);
+    for (int k = 0; k < NUM_BEE_FIELDS; k++)
+    {
+        if (fread(values, elem_size[k], n, f) != (size_t)n)
+        {
+            free(values);
+            return load_error(f, ids, file, "is truncated");
+        }
+        for (int j = 0; j < n; j++)
+        {
+            memcpy(field[k] + (size_t)ids[j] * elem_size[k], values + (size_t)j * elem_size[k], elem_size[k]);
+        }
+    }
+    free(values);
+
+    int num_parked = h.num_parked;
+    int *steps = (int *)malloc((2 * (size_t)num_parked + 1) * sizeof(int));
+    if (fread(steps, sizeof(int), 2 * (size_t)num_parked, f) != 2 * (size_t)num_parked ||
+        fread(sim->flowers, sizeof(Flower), sim_config.num_flowers, f) != (size_t)sim_config.num_flowers)
+    {
+        free(steps);
+        return load_error(f, ids, file, "is truncated");
+    }
+
+    for (int j = 0; j < n; j++)
+    {
+        if (sim->bees.state[ids[j]] >= NUM_BEE_STATES)
+        {
+            free(steps);
+            return load_error(f, ids, file, "is corrupt (bee states)");
+        }
+    }
+
+    // the grid was built from the flowers the run started with
+    flower_grid_free(&sim->flower_grid);
+    if (flower_grid_build(&sim->flower_grid, sim->flowers, sim_config.num_flowers, sim_config.bee_vision_range) != 0)
+    {
+        printf("Error: cannot allocate the flower grid\n");
+        free(steps);
+        free(ids);
+        fclose(f);
+        return -1;
+    }
+
+    // the ids are grouped by state, and buckets_add keeps their order
+    buckets_free(&sim->buckets);
+    buckets_build(&sim->buckets, sim->bees.state, ids, num_active);
+    for (int s = 0; s < NUM_BEE_STATES; s++)
+    {
+        if (sim->buckets.count[s] != h.bucket_count[s])
+        {
+            free(steps);
+            return load_error(f, ids, file, "is corrupt (bee states)");
+        }
+    }
+
+    // parked bees go back to their days in the order they were saved
+    for (int j = 0; j < num_parked; j++)
+    {
+        ParkedBee p = {ids[num_active + j], steps[j], steps[num_parked + j]};
+        if (p.wake_step < h.timestep || p.park_step >= h.timestep)
+        {
+            free(steps);
+            return load_error(f, ids, file, "is corrupt (parked bees)");
+        }
+        calendar_add(&sim->calendar, &p, sim->bees.state[p.bee]);
+    }
+    free(steps);
+
+    sim->timestep = h.timestep;
+    sim->total_nectar_collected = h.total_nectar_collected;
+
+    free(ids);
+    fclose(f);
+    return 0;
+}
@@ -0,0 +1,57 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+#include <stdint.h>
+#include "types.h"
+
+// Binary snapshot of one process's part of a run, written every
+// checkpoint_every steps and read back by --restart. Each process writes its
+// own file (CHECKPOINT_FILE, or CHECKPOINT_FILE.<rank> with several ranks),
+// so MPI ranks write in parallel. Values are in native byte order; a file is
+// meant to be read back by the same build on the same kind of machine.
+//
+//   CheckpointHeader                 96 bytes
+//   SimConfig                        config_size bytes
+//   int32_t ids[n]                   the process's bees in bucket order,
+//                                    bucket_count[s] of them per state s,
+//                                    then num_parked in calendar order
+//   per bee_fields() array:          values of ids[0..n) in the same order
+//     elem_size * n bytes
+//   int32_t park_step[num_parked]    of the parked bees, in calendar order
+//   int32_t wake_step[num_parked]
+//   Flower flowers[num_flowers]
+//
+// Random numbers are drawn from (seed, timestep) streams, so the config and
+// the timestep are all the RNG state there is. Restoring the buckets in their
+// saved order makes a restarted run bit-for-bit identical to one that never
+// stopped; the same goes for the calendar of parked bees.
+
+#define CHECKPOINT_MAGIC "BEECKPT"
+#define CHECKPOINT_VERSION 8
+#define CHECKPOINT_FILE "checkpoint.bin"
+
+typedef struct
+{
+    char magic[8]; // CHECKPOINT_MAGIC, NUL-terminated
+    uint32_t version;
+    uint32_t header_size; // sizeof(CheckpointHeader)
+    uint32_t config_size; // sizeof(SimConfig)
+    int32_t rank, num_ranks;
+    int32_t timestep; // steps completed
+    int32_t num_bees, num_flowers;
+    int32_t num_parked; // bees on the calendar (calendar.h)
+    int32_t bucket_count[NUM_BEE_STATES];
+    double total_nectar_collected;
+    uint64_t world; // world_identity() of the run, see world.h
+    uint8_t reserved[8];
+} CheckpointHeader;
+
+// Writes path.tmp and renames it over path, so a crash while writing leaves
+// the previous checkpoint intact. Returns 0 on success.
+int checkpoint_save(Simulation *sim, const char *path, int rank, int size);
+// Replaces the state of a freshly created simulation with the checkpoint.
+// Fails if the file was written with other parameters, from another world
+// or by another number of ranks. Returns 0 on success; errors are printed by the failing rank, and
+// the simulation may be half restored, so only destroy it then.
+int checkpoint_load(Simulation *sim, const char *path, int rank, int size);
+
+#endif
@@ -1,6 +1,9 @@
 #ifndef CONFIG_H
 #define CONFIG_H
 
+// Defaults for the run-time parameters in sim_config.h.
+// Override them per run with --key=value flags or a --config file.
+
 // for visualisation.py
 #define WORLD_SIZE 1000.0f
 #define HIVE_RADIUS 10.0f
@@ -15,6 +18,8 @@
 #define NUM_FLOWERS 2000
 #define MAX_TIMESTEPS 10000
 
+#define SEED 42
+
 #define BEE_SPEED 5.0f
 #define BEE_VISION_RANGE 20.0f
 #define SCOUT_RATIO 0.2f
@@ -27,8 +32,24 @@
 
 #define DANCE_DURATION 5
 #define DECISION_PROBABILITY 0.3f
+#define DANCE_WATCH_BATCH 1024 // idle bees per dance table refresh, with SYNC_STEP 0
+#define SYNC_STEP 1            // 1 = every idle bee watches the same dance table
+#define EVENTS 1               // 1 = skip dances and flights until they end
+#define SIMD_WIDTH 0           // widest flower scan and bee kernels (16, 8 or 1), 0 = any
+
+// positions.bin frame interval for visualize.py, 0 = off
+#define TRAJECTORY_EVERY 0
+#define TRAJECTORY_BUFFERS 3 // frame buffers for the writer thread
+#define TRAJECTORY_DROP 0    // 1 = drop frames instead of waiting for the disk
+
+// checkpoint.bin interval for --restart, 0 = off
+#define CHECKPOINT_EVERY 0
+
+// bees per state printed every N steps, 0 = off
+#define STATS_EVERY 0
 
-#define HIVE_X (WORLD_SIZE / 2.0f)
-#define HIVE_Y (WORLD_SIZE / 2.0f)
+// benchmark mode, off by default (make bench turns it on)
+#define BENCH_REPEATS 0
+#define BENCH_WARMUP 20
 
-#endif
\ No newline at end of file
+#endif
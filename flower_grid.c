@@ -0,0 +1,153 @@
+#include <stdlib.h>
+#include <limits.h>
+#include <math.h>
+#include "flower_grid.h"
+#include "bee_core.h"
+#include "flower_scan.h"
+#include "sim_config.h"
+
+static int cell_coord(FlowerGrid *grid, float v, int limit)
+{
+    int c = (int)floorf(v / grid->cell_size);
+    if (c < 0)
+        return 0;
+    if (c >= limit)
+        return limit - 1;
+    return c;
+}
+
+int flower_grid_build(FlowerGrid *grid, Flower *flowers, int num_flowers, float cell_size)
+{
+    // a tiny vision range or a huge world would otherwise ask for more
+    // cells than fit in memory; larger cells only mean more flowers per cell
+    if (cell_size < sim_config.world_size / FLOWER_GRID_MAX_SIDE)
+        cell_size = sim_config.world_size / FLOWER_GRID_MAX_SIDE;
+    grid->cell_size = cell_size;
+    grid->cols = (int)ceilf(sim_config.world_size / cell_size);
+    if (grid->cols < 1)
+        grid->cols = 1;
+    if (grid->cols > FLOWER_GRID_MAX_SIDE)
+        grid->cols = FLOWER_GRID_MAX_SIDE;
+    grid->rows = grid->cols;
+
+    size_t num_cells = (size_t)grid->cols * grid->rows;
+    size_t bytes = ((size_t)num_flowers * sizeof(float) + 63) / 64 * 64 + 64;
+    grid->cell_start = (int *)calloc(num_cells + 1, sizeof(int));
+    grid->flower_ids = (int *)malloc(((size_t)num_flowers + 1) * sizeof(int));
+    grid->x = (float *)aligned_alloc(64, bytes);
+    grid->y = (float *)aligned_alloc(64, bytes);
+    int *flower_cell = (int *)malloc(((size_t)num_flowers + 1) * sizeof(int));
+    int *fill = (int *)malloc(num_cells * sizeof(int));
+    if (!grid->cell_start || !grid->flower_ids || !grid->x || !grid->y || !flower_cell || !fill)
+    {
+        free(flower_cell);
+        free(fill);
+        flower_grid_free(grid);
+        return -1;
+    }
+
+    for (int i = 0; i < num_flowers; i++)
+    {
+        int cx = cell_coord(grid, flowers[i].position.x, grid->cols);
+        int cy = cell_coord(grid, flowers[i].position.y, grid->rows);
+        flower_cell[i] = cy * grid->cols + cx;
+        grid->cell_start[flower_cell[i] + 1]++;
+    }
+
+    for (size_t c = 0; c < num_cells; c++)
+    {
+        grid->cell_start[c + 1] += grid->cell_start[c];
+    }
+
+    // counting sort keeps ids ascending inside each cell
+    for (size_t c = 0; c < num_cells; c++)
+    {
+        fill[c] = grid->cell_start[c];
+    }
+    for (int i = 0; i < num_flowers; i++)
+    {
+        grid->flower_ids[fill[flower_cell[i]]++] = i;
+    }
+
+    // positions in the same order, so each cell is a contiguous run the
+    // vector kernels can load directly
+    for (int k = 0; k < num_flowers; k++)
+    {
+        grid->x[k] = flowers[grid->flower_ids[k]].position.x;
+        grid->y[k] = flowers[grid->flower_ids[k]].position.y;
+    }
+    grid->scan = flower_scan_select();
+    grid->cell_limit2 = flower_scan_limit(cell_size);
+
+    free(fill);
+    free(flower_cell);
+    return 0;
+}
+
+void flower_grid_free(FlowerGrid *grid)
+{
+    free(grid->cell_start);
+    free(grid->flower_ids);
+    free(grid->x);
+    free(grid->y);
+    grid->cell_start = NULL;
+    grid->flower_ids = NULL;
+    grid->x = grid->y = NULL;
+}
+
+// First k in [begin, end) with ids[k] >= value; ids ascend in that range
+static int lower_bound(const int *ids, int begin, int end, int value)
+{
+    while (begin < end)
+    {
+        int mid = begin + (end - begin) / 2;
+        if (ids[mid] < value)
+            begin = mid + 1;
+        else
+            end = mid;
+    }
+    return begin;
+}
+
+int flower_grid_find(FlowerGrid *grid, Flower *flowers, Vector2D pos, float range, int nectar_at)
+{
+    int cx0 = cell_coord(grid, pos.x - range, grid->cols);
+    int cx1 = cell_coord(grid, pos.x + range, grid->cols);
+    int cy0 = cell_coord(grid, pos.y - range, grid->rows);
+    int cy1 = cell_coord(grid, pos.y + range, grid->rows);
+
+    // scouts search at the cell size, so that limit is computed once
+    float limit2 = range == grid->cell_size ? grid->cell_limit2 : flower_scan_limit(range);
+    int best = INT_MAX;
+
+    for (int cy = cy0; cy <= cy1; cy++)
+    {
+        for (int cx = cx0; cx <= cx1; cx++)
+        {
+            int cell = cy * grid->cols + cx;
+            int begin = grid->cell_start[cell];
+            int end = grid->cell_start[cell + 1];
+
+            // ids ascend within a cell: only the ones below best can win,
+            // and the first hit with nectar is the cell's answer
+            if (best != INT_MAX)
+                end = lower_bound(grid->flower_ids, begin, end, best);
+
+            for (int k = begin; k < end; k++)
+            {
+                k = grid->scan(grid->x, grid->y, k, end, pos.x, pos.y, limit2);
+                if (k == end)
+                    break;
+
+                int i = grid->flower_ids[k];
+                if (nectar_at < 0 || flower_nectar(&flowers[i], nectar_at) > 0)
+                {
+                    best = i;
+                    break;
+                }
+            }
+        }
+    }
+
+    return best == INT_MAX ? -1 : best;
+}
@@ -0,0 +1,19 @@
+#ifndef FLOWER_GRID_H
+#define FLOWER_GRID_H
+#include "types.h"
+
+// Uniform grid over the world, flowers bucketed by cell (CSR layout).
+// Flower positions never change, so the grid is built once per simulation.
+// Cells are at least world_size / FLOWER_GRID_MAX_SIDE wide. Returns 0, or
+// -1 if it cannot be allocated (the grid is then empty but can be freed).
+#define FLOWER_GRID_MAX_SIDE 4096
+int flower_grid_build(FlowerGrid *grid, Flower *flowers, int num_flowers, float cell_size);
+void flower_grid_free(FlowerGrid *grid);
+
+// Lowest flower index with distance(pos, flower) < range, or -1. Cells are
+// scanned with the SIMD kernel picked when the grid is built (flower_scan.h).
+// With nectar_at >= 0 only flowers with nectar left at that timestep
+// qualify. Gives the same answer as a linear scan over all flowers.
+int flower_grid_find(FlowerGrid *grid, Flower *flowers, Vector2D pos, float range, int nectar_at);
+
+#endif
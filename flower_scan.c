@@ -0,0 +1,118 @@
+#include <math.h>
+#include "flower_scan.h"
+#include "sim_config.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define HAVE_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+static int scan_scalar(const float *x, const float *y, int begin, int end, float px, float py, float limit2)
+{
+    for (int k = begin; k < end; k++)
+    {
+        float dx = px - x[k];
+        float dy = py - y[k];
+        if (dx * dx + dy * dy < limit2)
+            return k;
+    }
+    return end;
+}
+
+#ifdef HAVE_X86_KERNELS
+// Neither target enables FMA, and the Makefile builds with
+// -ffp-contract=off, so d2 is rounded exactly like the scalar loop.
+
+__attribute__((target("avx2"))) static int scan_avx2(const float *x, const float *y, int begin, int end,
+                                                      float px, float py, float limit2)
+{
+    __m256 vx = _mm256_set1_ps(px);
+    __m256 vy = _mm256_set1_ps(py);
+    __m256 vlimit = _mm256_set1_ps(limit2);
+
+    int k = begin;
+    for (; k + 8 <= end; k += 8)
+    {
+        __m256 dx = _mm256_sub_ps(vx, _mm256_loadu_ps(x + k));
+        __m256 dy = _mm256_sub_ps(vy, _mm256_loadu_ps(y + k));
+        __m256 d2 = _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy));
+        int hits = _mm256_movemask_ps(_mm256_cmp_ps(d2, vlimit, _CMP_LT_OQ));
+        if (hits)
+            return k + __builtin_ctz(hits);
+    }
+
+    if (k < end)
+    {
+        // masked loads never touch memory past end
+        __m256i live = _mm256_cmpgt_epi32(_mm256_set1_epi32(end - k), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+        __m256 dx = _mm256_sub_ps(vx, _mm256_maskload_ps(x + k, live));
+        __m256 dy = _mm256_sub_ps(vy, _mm256_maskload_ps(y + k, live));
+        __m256 d2 = _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy));
+        int hits = _mm256_movemask_ps(_mm256_cmp_ps(d2, vlimit, _CMP_LT_OQ)) & ((1 << (end - k)) - 1);
+        if (hits)
+            return k + __builtin_ctz(hits);
+    }
+    return end;
+}
+
+__attribute__((target("avx512f"))) static int scan_avx512(const float *x, const float *y, int begin, int end,
+                                                           float px, float py, float limit2)
+{
+    __m512 vx = _mm512_set1_ps(px);
+    __m512 vy = _mm512_set1_ps(py);
+    __m512 vlimit = _mm512_set1_ps(limit2);
+
+    for (int k = begin; k < end; k += 16)
+    {
+        __mmask16 live = end - k >= 16 ? 0xFFFF : (__mmask16)((1u << (end - k)) - 1);
+        __m512 dx = _mm512_sub_ps(vx, _mm512_maskz_loadu_ps(live, x + k));
+        __m512 dy = _mm512_sub_ps(vy, _mm512_maskz_loadu_ps(live, y + k));
+        __m512 d2 = _mm512_add_ps(_mm512_mul_ps(dx, dx), _mm512_mul_ps(dy, dy));
+        unsigned hits = _mm512_mask_cmp_ps_mask(live, d2, vlimit, _CMP_LT_OQ);
+        if (hits)
+            return k + __builtin_ctz(hits);
+    }
+    return end;
+}
+#endif
+
+FlowerScan flower_scan_select(void)
+{
+    int width = run_config.simd_width;
+#ifdef HAVE_X86_KERNELS
+    __builtin_cpu_init();
+    if ((width == 0 || width >= 16) && __builtin_cpu_supports("avx512f"))
+        return scan_avx512;
+    if ((width == 0 || width >= 8) && __builtin_cpu_supports("avx2"))
+        return scan_avx2;
+#else
+    (void)width;
+#endif
+    return scan_scalar;
+}
+
+const char *flower_scan_name(FlowerScan scan)
+{
+#ifdef HAVE_X86_KERNELS
+    if (scan == scan_avx512)
+        return "avx512";
+    if (scan == scan_avx2)
+        return "avx2";
+#endif
+    return scan == scan_scalar ? "scalar" : "unknown";
+}
+
+float flower_scan_limit(float range)
+{
+    // sqrtf is correctly rounded and so monotonic: step to the boundary
+    float limit2 = range * range;
+    while (limit2 > 0.0f && sqrtf(limit2) >= range)
+    {
+        limit2 = nextafterf(limit2, 0.0f);
+    }
+    while (sqrtf(limit2) < range)
+    {
+        limit2 = nextafterf(limit2, INFINITY);
+    }
+    return limit2;
+}
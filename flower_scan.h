@@ -0,0 +1,22 @@
+#ifndef FLOWER_SCAN_H
+#define FLOWER_SCAN_H
+#include "types.h"
+
+// Distance kernels over flower positions stored as arrays (x[], y[]).
+// A FlowerScan returns the first k in [begin, end) with
+//   dx * dx + dy * dy < limit2,  dx = px - x[k], dy = py - y[k]
+// or end if there is none. The AVX2 and AVX-512 kernels test 8 and 16
+// flowers per instruction; all kernels round the same way, so they give the
+// same answer as the scalar one.
+
+// Widest kernel the CPU supports, at most run_config.simd_width lanes
+// (0 = no limit, 1 = scalar)
+FlowerScan flower_scan_select(void);
+// "scalar", "avx2" or "avx512", for the run banner
+const char *flower_scan_name(FlowerScan scan);
+
+// Smallest limit2 with sqrtf(limit2) >= range, so d2 < limit2 exactly when
+// sqrtf(d2) < range and the kernels keep distance()'s cutoff bit for bit
+float flower_scan_limit(float range);
+
+#endif
@@ -0,0 +1,101 @@
+"""
+Bee Foraging Simulation - World files
+Writes a world file for --world (see world.h): bees at the hive and either
+random flowers or a flower field read from a CSV file with the columns
+x,y,nectar_total,capacity and optionally regen_rate.
+
+    python3 make_world.py world.bin --bees 10000000 --flowers 200000
+    python3 make_world.py field.bin --flowers-csv field.csv --world-size 5000
+"""
+
+import argparse
+import sys
+import numpy as np
+
+IDLE, SCOUT = 0, 1
+
+HEADER_DTYPE = np.dtype([
+    ('magic', 'S8'),
+    ('version', '<u4'),
+    ('header_size', '<u4'),
+    ('num_bees', '<u4'),
+    ('num_flowers', '<u4'),
+    ('world_size', '<f4'),
+    ('hive_radius', '<f4'),
+    ('reserved', 'u1', (32,)),
+])
+
+
+def parse_args():
+    p = argparse.ArgumentParser(description="Write a world file for --world")
+    p.add_argument('out')
+    p.add_argument('--bees', type=int, default=20000)
+    p.add_argument('--flowers', type=int, default=2000, help="random flowers (ignored with --flowers-csv)")
+    p.add_argument('--flowers-csv', help="x,y,nectar_total,capacity[,regen_rate] per line, with that header")
+    p.add_argument('--world-size', type=float, default=1000.0)
+    p.add_argument('--hive-radius', type=float, default=10.0)
+    p.add_argument('--scout-ratio', type=float, default=0.2)
+    p.add_argument('--energy', type=float, default=100.0)
+    p.add_argument('--nectar', type=float, default=5.0, help="nectar_total of random flowers")
+    p.add_argument('--capacity', type=int, default=5, help="capacity of random flowers")
+    p.add_argument('--regen', type=float, default=0.1, help="nectar regrown per step, unless the CSV has regen_rate")
+    p.add_argument('--seed', type=int, default=42)
+    return p.parse_args()
+
+
+def main():
+    args = parse_args()
+    rng = np.random.default_rng(args.seed)
+
+    if args.flowers_csv:
+        field = np.genfromtxt(args.flowers_csv, delimiter=',', names=True, ndmin=1)
+        flower_x, flower_y = field['x'], field['y']
+        nectar, capacity = field['nectar_total'], field['capacity']
+        if 'regen_rate' in field.dtype.names:
+            regen = field['regen_rate']
+        else:
+            regen = np.full(len(flower_x), args.regen)
+    else:
+        flower_x = rng.uniform(0, args.world_size, args.flowers)
+        flower_y = rng.uniform(0, args.world_size, args.flowers)
+        nectar = np.full(args.flowers, args.nectar)
+        capacity = np.full(args.flowers, args.capacity)
+        regen = np.full(args.flowers, args.regen)
+    num_flowers = len(flower_x)
+
+    # bees start around the hive; sorted by x, every strip of the world is
+    # one contiguous range of ids, so an MPI rank reads only its own part
+    centre = args.world_size / 2
+    bee_x = (centre + rng.uniform(-args.hive_radius, args.hive_radius, args.bees)).astype('<f4')
+    bee_y = (centre + rng.uniform(-args.hive_radius, args.hive_radius, args.bees)).astype('<f4')
+    state = np.full(args.bees, IDLE, dtype='u1')
+    state[rng.permutation(args.bees)[:int(args.bees * args.scout_ratio)]] = SCOUT
+    order = np.argsort(bee_x, kind='stable')
+
+    header = np.zeros(1, dtype=HEADER_DTYPE)
+    header['magic'] = b'BEEWRLD'
+    header['version'] = 2
+    header['header_size'] = HEADER_DTYPE.itemsize
+    header['num_bees'] = args.bees
+    header['num_flowers'] = num_flowers
+    header['world_size'] = args.world_size
+    header['hive_radius'] = args.hive_radius
+
+    with open(args.out, 'wb') as f:
+        header.tofile(f)
+        bee_x[order].tofile(f)
+        bee_y[order].tofile(f)
+        np.full(args.bees, args.energy, dtype='<f4').tofile(f)
+        state[order].tofile(f)
+        np.zeros((4 - args.bees % 4) % 4, dtype='u1').tofile(f)
+        np.asarray(flower_x, dtype='<f4').tofile(f)
+        np.asarray(flower_y, dtype='<f4').tofile(f)
+        np.asarray(nectar, dtype='<f4').tofile(f)
+        np.asarray(regen, dtype='<f4').tofile(f)
+        np.asarray(capacity, dtype='<i4').tofile(f)
+
+    print(f"Wrote {args.out}: {args.bees} bees, {num_flowers} flowers")
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,55 @@
+#ifndef RNG_H
+#define RNG_H
+#include <stdint.h>
+
+// Counter-based random numbers. A stream is keyed on (seed, purpose, id,
+// timestep) and its n-th draw is a hash of the key and n, so every value is
+// fixed no matter which thread or rank draws it, or in what order. This is
+// what lets seq, omp and mpi produce the same trajectories.
+
+typedef struct
+{
+    uint64_t key;
+    uint32_t draw;
+} Rng;
+
+// One stream purpose per place that draws, so their numbers never overlap
+enum
+{
+    RNG_INIT_BEES,
+    RNG_INIT_FLOWERS,
+    RNG_SCOUT,
+    RNG_WATCH_DANCES,
+};
+
+// SplitMix64 finalizer
+static inline uint64_t rng_mix(uint64_t z)
+{
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+static inline Rng rng_stream(uint64_t seed, int purpose, int id, int timestep)
+{
+    Rng r;
+    uint64_t k = rng_mix(seed + (uint64_t)purpose * 0x9E3779B97F4A7C15ULL);
+    k = rng_mix(k ^ (uint32_t)id);
+    r.key = rng_mix(k ^ ((uint64_t)(uint32_t)timestep << 32));
+    r.draw = 0;
+    return r;
+}
+
+static inline uint32_t rng_next(Rng *r)
+{
+    r->draw++;
+    return (uint32_t)(rng_mix(r->key + r->draw * 0x9E3779B97F4A7C15ULL) >> 32);
+}
+
+// Uniform in [min, max), 24 random bits
+static inline float rng_float(Rng *r, float min, float max)
+{
+    return min + (max - min) * ((float)(rng_next(r) >> 8) * 0x1p-24f);
+}
+
+#endif
@@ -0,0 +1,24 @@
+#!/bin/sh
+# Runs the hybrid (MPI + OpenMP) build.
+# usage: ./run_hybrid.sh [ranks] [threads per rank] [simulation args...]
+#
+# Ranks are placed one per NUMA domain (HYBRID_MAP, default numa) with
+# THREADS cores each, and the OpenMP threads are bound to those cores.
+# HYBRID_MAP=none leaves placement to the MPI launcher.
+
+RANKS=${1:-2}
+THREADS=${2:-4}
+[ $# -gt 0 ] && shift
+[ $# -gt 0 ] && shift
+
+MPIRUN=${MPIRUN:-mpirun}
+HYBRID_MAP=${HYBRID_MAP:-numa}
+
+export OMP_NUM_THREADS=$THREADS
+export OMP_PLACES=cores
+export OMP_PROC_BIND=close
+
+if [ "$HYBRID_MAP" = none ]; then
+    exec $MPIRUN -np "$RANKS" ./hybrid "$@"
+fi
+exec $MPIRUN -np "$RANKS" --map-by "$HYBRID_MAP:PE=$THREADS" --bind-to core ./hybrid "$@"
@@ -0,0 +1,340 @@
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <stddef.h>
+#include "sim_config.h"
+#include "world.h"
+
+#ifndef FIXED_CONFIG
+SimConfig sim_config = SIM_CONFIG_DEFAULTS;
+#endif
+RunConfig run_config = RUN_CONFIG_DEFAULTS;
+
+// set by config_parse_args on ranks that should stay quiet
+static int quiet = 0;
+
+// --restart FILE
+static const char *restart_path = NULL;
+
+static void config_error(const char *fmt, ...)
+{
+    if (quiet)
+        return;
+    va_list args;
+    va_start(args, fmt);
+    vfprintf(stderr, fmt, args);
+    va_end(args);
+}
+
+typedef struct
+{
+    const char *key;
+    int is_int;
+    size_t offset;
+    int run_only; // a RunConfig field, else a SimConfig one
+} ConfigKey;
+
+#define INT_KEY(field) {#field, 1, offsetof(SimConfig, field), 0}
+#define FLOAT_KEY(field) {#field, 0, offsetof(SimConfig, field), 0}
+#define RUN_KEY(field) {#field, 1, offsetof(RunConfig, field), 1}
+
+static const ConfigKey config_keys[] = {
+    INT_KEY(num_bees),
+    INT_KEY(num_flowers),
+    RUN_KEY(max_timesteps),
+    INT_KEY(seed),
+    FLOAT_KEY(world_size),
+    FLOAT_KEY(hive_radius),
+    FLOAT_KEY(bee_speed),
+    FLOAT_KEY(bee_vision_range),
+    FLOAT_KEY(scout_ratio),
+    FLOAT_KEY(max_energy),
+    FLOAT_KEY(energy_cost),
+    FLOAT_KEY(flower_nectar_max),
+    INT_KEY(flower_capacity),
+    FLOAT_KEY(nectar_regen_rate),
+    INT_KEY(dance_duration),
+    FLOAT_KEY(decision_probability),
+    INT_KEY(dance_watch_batch),
+    INT_KEY(sync_step),
+    INT_KEY(events),
+    RUN_KEY(simd_width),
+    RUN_KEY(trajectory_every),
+    RUN_KEY(trajectory_buffers),
+    RUN_KEY(trajectory_drop),
+    RUN_KEY(checkpoint_every),
+    RUN_KEY(stats_every),
+    RUN_KEY(bench_repeats),
+    RUN_KEY(bench_warmup),
+};
+
+#define NUM_CONFIG_KEYS (int)(sizeof(config_keys) / sizeof(config_keys[0]))
+
+static const ConfigKey *find_key(const char *key)
+{
+    for (int k = 0; k < NUM_CONFIG_KEYS; k++)
+    {
+        if (strcmp(config_keys[k].key, key) == 0)
+            return &config_keys[k];
+    }
+    return NULL;
+}
+
+static const char *key_field(const ConfigKey *k)
+{
+    return (k->run_only ? (const char *)&run_config : (const char *)&sim_config) + k->offset;
+}
+
+// Values the engine cannot run with
+static const char *check_value(const ConfigKey *k, int iv, float fv)
+{
+    if (k->is_int)
+    {
+        if (strcmp(k->key, "trajectory_drop") == 0 || strcmp(k->key, "sync_step") == 0 ||
+            strcmp(k->key, "events") == 0)
+            return iv != 0 && iv != 1 ? "must be 0 or 1" : NULL;
+        if (strcmp(k->key, "max_timesteps") == 0 || strcmp(k->key, "seed") == 0 ||
+            strcmp(k->key, "trajectory_every") == 0 || strcmp(k->key, "simd_width") == 0 ||
+            strcmp(k->key, "checkpoint_every") == 0 || strcmp(k->key, "stats_every") == 0 || strncmp(k->key, "bench_", 6) == 0)
+            return iv < 0 ? "must be >= 0" : NULL;
+        return iv < 1 ? "must be >= 1" : NULL;
+    }
+    if (strcmp(k->key, "scout_ratio") == 0 || strcmp(k->key, "decision_probability") == 0)
+        return fv < 0.0f || fv > 1.0f ? "must be in [0, 1]" : NULL;
+    if (strcmp(k->key, "world_size") == 0 || strcmp(k->key, "bee_vision_range") == 0 ||
+        strcmp(k->key, "flower_nectar_max") == 0 || strcmp(k->key, "max_energy") == 0)
+        return fv > 0.0f ? NULL : "must be > 0";
+    return fv < 0.0f ? "must be >= 0" : NULL;
+}
+
+int config_set(const char *key, const char *value)
+{
+    const ConfigKey *k = find_key(key);
+    if (!k)
+    {
+        config_error("Unknown parameter '%s'\n", key);
+        return -1;
+    }
+
+    char *end;
+    long iv = 0;
+    float fv = 0.0f;
+    if (k->is_int)
+        iv = strtol(value, &end, 10);
+    else
+        fv = strtof(value, &end);
+
+    while (isspace((unsigned char)*end))
+        end++;
+    if (end == value || *end != '\0' || iv != (int)iv)
+    {
+        config_error("Bad value '%s' for %s\n", value, key);
+        return -1;
+    }
+
+    const char *problem = check_value(k, (int)iv, fv);
+    if (problem)
+    {
+        config_error("%s %s (got %s)\n", key, problem, value);
+        return -1;
+    }
+
+#ifdef FIXED_CONFIG
+    if (!k->run_only)
+    {
+        config_error("%s is fixed at compile time in this build (FIXED_CONFIG)\n", key);
+        return -1;
+    }
+#endif
+    char *field = (char *)key_field(k);
+    if (k->is_int)
+        *(int *)field = (int)iv;
+    else
+        *(float *)field = fv;
+    return 0;
+}
+
+static char *trim(char *s)
+{
+    while (isspace((unsigned char)*s))
+        s++;
+    char *end = s + strlen(s);
+    while (end > s && isspace((unsigned char)end[-1]))
+        end--;
+    *end = '\0';
+    return s;
+}
+
+int config_load_file(const char *path)
+{
+    FILE *f = fopen(path, "r");
+    if (!f)
+    {
+        config_error("Error opening config file %s\n", path);
+        return -1;
+    }
+
+    char line[256];
+    int line_no = 0;
+    int status = 0;
+    while (status == 0 && fgets(line, sizeof(line), f))
+    {
+        line_no++;
+        char *hash = strchr(line, '#');
+        if (hash)
+            *hash = '\0';
+
+        char *s = trim(line);
+        if (*s == '\0')
+            continue;
+
+        char *eq = strchr(s, '=');
+        if (!eq)
+        {
+            config_error("%s:%d: expected key = value\n", path, line_no);
+            status = -1;
+            break;
+        }
+        *eq = '\0';
+
+        if (config_set(trim(s), trim(eq + 1)) != 0)
+        {
+            config_error("%s:%d: rejected\n", path, line_no);
+            status = -1;
+        }
+    }
+
+    fclose(f);
+    return status;
+}
+
+static void print_usage(const char *prog)
+{
+    printf("Usage: %s [options] [driver arguments]\n", prog);
+    printf("  --config FILE     read key = value lines from FILE\n");
+    printf("  --world FILE      load bees and flowers from FILE (make_world.py)\n");
+    printf("  --restart FILE    continue from a checkpoint (same parameters and ranks)\n");
+    printf("  --KEY=VALUE       set one parameter (also --KEY VALUE)\n");
+    printf("  --help            show this message\n");
+    printf("Parameters and their current values:\n");
+    config_print(stdout);
+}
+
+int config_parse_args(int argc, char **argv, int report)
+{
+    quiet = !report;
+
+    int kept = 1;
+    int status = 0;
+    for (int a = 1; a < argc && status == 0; a++)
+    {
+        char *arg = argv[a];
+        if (strncmp(arg, "--", 2) != 0)
+        {
+            argv[kept++] = arg;
+            continue;
+        }
+
+        if (strcmp(arg, "--help") == 0)
+        {
+            if (report)
+                print_usage(argv[0]);
+            status = 1;
+            break;
+        }
+
+        char key[64];
+        const char *value;
+        const char *eq = strchr(arg + 2, '=');
+        size_t key_len = eq ? (size_t)(eq - (arg + 2)) : strlen(arg + 2);
+        if (key_len >= sizeof(key))
+            key_len = sizeof(key) - 1;
+        memcpy(key, arg + 2, key_len);
+        key[key_len] = '\0';
+
+        if (eq)
+        {
+            value = eq + 1;
+        }
+        else if (a + 1 < argc)
+        {
+            value = argv[++a];
+        }
+        else
+        {
+            config_error("Missing value for --%s\n", key);
+            status = -1;
+            break;
+        }
+
+        if (strcmp(key, "config") == 0)
+            status = config_load_file(value);
+        else if (strcmp(key, "restart") == 0)
+            restart_path = value;
+        else if (strcmp(key, "world") == 0)
+        {
+            const char *problem = world_open(value);
+            if (problem)
+                config_error("World file %s %s\n", value, problem);
+            status = problem ? -1 : 0;
+        }
+        else
+            status = config_set(key, value);
+    }
+
+    quiet = 0;
+
+    if (status != 0)
+        return status > 0 ? 0 : -1;
+
+    argv[kept] = NULL;
+    return kept;
+}
+
+void config_print(FILE *f)
+{
+    for (int k = 0; k < NUM_CONFIG_KEYS; k++)
+    {
+        const char *field = key_field(&config_keys[k]);
+        if (config_keys[k].is_int)
+            fprintf(f, "%s = %d\n", config_keys[k].key, *(const int *)field);
+        else
+            fprintf(f, "%s = %g\n", config_keys[k].key, *(const float *)field);
+    }
+}
+
+void config_print_json(FILE *f)
+{
+    fprintf(f, "{");
+    for (int k = 0; k < NUM_CONFIG_KEYS; k++)
+    {
+        const char *field = key_field(&config_keys[k]);
+        const char *sep = k + 1 < NUM_CONFIG_KEYS ? ", " : "";
+        if (config_keys[k].is_int)
+            fprintf(f, "\"%s\": %d%s", config_keys[k].key, *(const int *)field, sep);
+        else
+            fprintf(f, "\"%s\": %g%s", config_keys[k].key, *(const float *)field, sep);
+    }
+    fprintf(f, "}");
+}
+
+const char *config_restart_path(void)
+{
+    return restart_path;
+}
+
+const char *config_mismatch(const SimConfig *saved)
+{
+    for (int k = 0; k < NUM_CONFIG_KEYS; k++)
+    {
+        if (config_keys[k].run_only)
+            continue;
+        const char *a = (const char *)&sim_config + config_keys[k].offset;
+        const char *b = (const char *)saved + config_keys[k].offset;
+        if (memcmp(a, b, config_keys[k].is_int ? sizeof(int) : sizeof(float)) != 0)
+            return config_keys[k].key;
+    }
+    return NULL;
+}
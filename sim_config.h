@@ -0,0 +1,80 @@
+#ifndef SIM_CONFIG_H
+#define SIM_CONFIG_H
+#include <stdio.h>
+#include "types.h"
+#include "config.h"
+
+#define SIM_CONFIG_DEFAULTS                           \
+    {                                                 \
+        .num_bees = NUM_BEES,                         \
+        .num_flowers = NUM_FLOWERS,                   \
+        .seed = SEED,                                 \
+        .world_size = WORLD_SIZE,                     \
+        .hive_radius = HIVE_RADIUS,                   \
+        .bee_speed = BEE_SPEED,                       \
+        .bee_vision_range = BEE_VISION_RANGE,         \
+        .scout_ratio = SCOUT_RATIO,                   \
+        .max_energy = MAX_ENERGY,                     \
+        .energy_cost = ENERGY_COST,                   \
+        .flower_nectar_max = FLOWER_NECTAR_MAX,       \
+        .flower_capacity = FLOWER_CAPACITY,           \
+        .nectar_regen_rate = NECTAR_REGEN_RATE,       \
+        .dance_duration = DANCE_DURATION,             \
+        .decision_probability = DECISION_PROBABILITY, \
+        .dance_watch_batch = DANCE_WATCH_BATCH,       \
+        .sync_step = SYNC_STEP,                       \
+        .events = EVENTS,                             \
+    }
+
+#define RUN_CONFIG_DEFAULTS                       \
+    {                                             \
+        .max_timesteps = MAX_TIMESTEPS,           \
+        .simd_width = SIMD_WIDTH,                 \
+        .trajectory_every = TRAJECTORY_EVERY,     \
+        .trajectory_buffers = TRAJECTORY_BUFFERS, \
+        .trajectory_drop = TRAJECTORY_DROP,       \
+        .checkpoint_every = CHECKPOINT_EVERY,     \
+        .stats_every = STATS_EVERY,               \
+        .bench_repeats = BENCH_REPEATS,           \
+        .bench_warmup = BENCH_WARMUP,             \
+    }
+
+// Parameters of the current run. Set them before create_simulation and leave
+// them alone afterwards. Built with -DFIXED_CONFIG (make FIXED_CONFIG=1)
+// sim_config is a compile-time constant, so every parameter that shapes the
+// run folds into the code like the old macros did and overrides of it are
+// rejected; run_config (length, output, benchmark) stays settable.
+#ifdef FIXED_CONFIG
+__attribute__((unused)) static const SimConfig sim_config = SIM_CONFIG_DEFAULTS;
+#else
+extern SimConfig sim_config;
+#endif
+extern RunConfig run_config;
+
+// The hive sits in the middle of the world
+#define HIVE_X (sim_config.world_size / 2.0f)
+#define HIVE_Y (sim_config.world_size / 2.0f)
+
+// Sets one parameter by name (the SimConfig or RunConfig field name). 0 on success.
+int config_set(const char *key, const char *value);
+
+// Reads "key = value" lines; '#' starts a comment. 0 on success.
+int config_load_file(const char *path);
+
+// Applies --key=value, --key value and --config FILE in order, so later
+// options win. Other arguments are left in argv for the driver. Returns the
+// new argc, 0 if --help was printed, -1 on error. Messages are printed only
+// when report is set (rank 0 under MPI).
+int config_parse_args(int argc, char **argv, int report);
+
+// FILE given with --restart, or NULL
+const char *config_restart_path(void);
+// First parameter that differs between sim_config and saved, or NULL when
+// they agree
+const char *config_mismatch(const SimConfig *saved);
+
+void config_print(FILE *f);
+// One-line JSON object with every parameter
+void config_print_json(FILE *f);
+
+#endif
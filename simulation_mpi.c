@@ -1,642 +1,772 @@
 #include <stdio.h>
 #include <stdlib.h>
-#include <math.h>
 #include <string.h>
-#include <time.h>
 #include <mpi.h>
-#include "config.h"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include "sim_config.h"
 #include "types.h"
-
-float distance(Vector2D a, Vector2D b)
+#include "bee_core.h"
+#include "flower_scan.h"
+#include "bee_kernels.h"
+#include "state_buckets.h"
+#include "calendar.h"
+#include "bench.h"
+#include "trajectory.h"
+#include "checkpoint.h"
+
+// Built twice: mpi against the serial core, hybrid against the OpenMP core.
+// In the hybrid build each rank runs the core's parallel regions over its
+// strip, and only the main thread calls MPI, in between those regions.
+#ifdef _OPENMP
+#define TARGET_NAME "hybrid"
+#define TARGET_TITLE "MPI + OpenMP"
+#else
+#define TARGET_NAME "mpi"
+#define TARGET_TITLE "MPI"
+#endif
+
+enum
 {
-    float dx = a.x - b.x;
-    float dy = a.y - b.y;
-    return sqrtf(dx * dx + dy * dy);
-}
-
-float random_float_r(unsigned int *seed, float min, float max)
+    PHASE_UPDATE_BEES,
+    PHASE_HARVEST, // includes the start of the nectar broadcast
+    PHASE_SYNC_DANCES,
+    PHASE_WATCH_DANCES,
+    PHASE_SEND_FOLLOWERS,
+    PHASE_SYNC_FLOWERS,
+    PHASE_MIGRATE_BEES,
+    PHASE_REDUCE_TOTALS, // waits for the fused nectar + state counts
+    NUM_PHASES
+};
+static const char *phase_names[NUM_PHASES] = {"update_bees", "harvest", "sync_dances", "watch_dances",
+                                              "send_followers", "sync_flowers", "migrate_bees", "reduce_totals"};
+
+// Personalized all-to-all of fixed-size records. The caller counts every
+// record's destination with exchange_count, then writes the records into
+// exchange_slot in the same order and calls exchange_run. Received records
+// are grouped by source rank, in rank order.
+typedef struct
 {
-    return min + (max - min) * ((float)rand_r(seed) / RAND_MAX);
-}
-
-Vector2D random_position_r(unsigned int *seed)
+    int record_size;
+    int *send_counts; // bytes, per rank
+    int *send_displacements;
+    int *recv_counts;
+    int *recv_displacements;
+    int *fill;
+    char *send;
+    char *recv;
+    int num_received; // records
+} Exchange;
+
+static void exchange_init(Exchange *x, int record_size, int size)
 {
-    Vector2D pos;
-    pos.x = random_float_r(seed, 0, WORLD_SIZE);
-    pos.y = random_float_r(seed, 0, WORLD_SIZE);
-    return pos;
+    x->record_size = record_size;
+    x->send_counts = (int *)calloc(size, sizeof(int));
+    x->send_displacements = (int *)malloc(size * sizeof(int));
+    x->recv_counts = (int *)malloc(size * sizeof(int));
+    x->recv_displacements = (int *)malloc(size * sizeof(int));
+    x->fill = (int *)malloc(size * sizeof(int));
+    x->send = x->recv = NULL;
+    x->num_received = 0;
 }
 
-Vector2D normalize(Vector2D v)
+static void exchange_count(Exchange *x, int dest)
 {
-    float len = sqrtf(v.x * v.x + v.y * v.y);
-    if (len > 0.0001f)
-    {
-        v.x /= len;
-        v.y /= len;
-    }
-    return v;
+    x->send_counts[dest] += x->record_size;
 }
 
-void init_all_bees(Bee *bees, int num_bees, unsigned int *seed)
+// Lays out the send buffer once all records are counted
+static void exchange_layout(Exchange *x, int size)
 {
-    for (int i = 0; i < num_bees; i++)
-    {
-        bees[i].id = i;
-        bees[i].position.x = HIVE_X + random_float_r(seed, -HIVE_RADIUS, HIVE_RADIUS);
-        bees[i].position.y = HIVE_Y + random_float_r(seed, -HIVE_RADIUS, HIVE_RADIUS);
-        bees[i].velocity.x = 0;
-        bees[i].velocity.y = 0;
-
-        if (i < (int)(num_bees * SCOUT_RATIO))
-        {
-            bees[i].state = SCOUT;
-        }
-        else
-        {
-            bees[i].state = IDLE;
-        }
-
-        bees[i].energy = MAX_ENERGY;
-        bees[i].target_flower = -1;
-        bees[i].following_dance = -1;
-        bees[i].nectar_found = 0;
-        bees[i].dance_followers = 0;
-        bees[i].dance_timer = 0;
-    }
-}
+    if (x->send)
+        return;
 
-void init_flowers(Flower *flowers, int num_flowers, unsigned int *seed)
-{
-    for (int i = 0; i < num_flowers; i++)
+    int bytes = 0;
+    for (int r = 0; r < size; r++)
     {
-        flowers[i].position = random_position_r(seed);
-        flowers[i].nectar_total = FLOWER_NECTAR_MAX;
-        flowers[i].nectar_available = FLOWER_NECTAR_MAX;
-        flowers[i].bees_feeding = 0;
-        flowers[i].capacity = FLOWER_CAPACITY;
+        x->send_displacements[r] = x->fill[r] = bytes;
+        bytes += x->send_counts[r];
     }
+    x->send = (char *)malloc((size_t)bytes + 1);
 }
 
-Simulation *create_simulation(int rank, int size)
-{
-    Simulation *sim = (Simulation *)malloc(sizeof(Simulation));
-
-    sim->bees = (Bee *)malloc(NUM_BEES * sizeof(Bee));
-    sim->flowers = (Flower *)malloc(NUM_FLOWERS * sizeof(Flower));
-    sim->dances = (WaggleDance *)malloc(NUM_BEES * sizeof(WaggleDance));
-    sim->num_dances = 0;
-    sim->total_nectar_collected = 0;
-    sim->timestep = 0;
-
-    int bees_per_proc = NUM_BEES / size;
-    int remainder = NUM_BEES % size;
-
-    sim->bee_offset = rank * bees_per_proc + (rank < remainder ? rank : remainder);
-    sim->num_local_bees = bees_per_proc + (rank < remainder ? 1 : 0);
-
-    unsigned int seed = 42;
-    init_all_bees(sim->bees, NUM_BEES, &seed);
-
-    seed = 123;
-    init_flowers(sim->flowers, NUM_FLOWERS, &seed);
-
-    return sim;
-}
-
-void destroy_simulation(Simulation *sim)
-{
-    free(sim->bees);
-    free(sim->flowers);
-    free(sim->dances);
-    free(sim);
-}
-
-void move_towards(Bee *bee, Vector2D target)
+static char *exchange_slot(Exchange *x, int dest, int size)
 {
-    Vector2D direction;
-    direction.x = target.x - bee->position.x;
-    direction.y = target.y - bee->position.y;
-
-    direction = normalize(direction);
-
-    bee->velocity.x = direction.x * BEE_SPEED;
-    bee->velocity.y = direction.y * BEE_SPEED;
-
-    bee->position.x += bee->velocity.x;
-    bee->position.y += bee->velocity.y;
+    exchange_layout(x, size);
 
-    bee->energy -= ENERGY_COST;
+    char *slot = x->send + x->fill[dest];
+    x->fill[dest] += x->record_size;
+    return slot;
 }
 
-void scout_behavior(Bee *bee, Flower *flowers, int num_flowers, unsigned int *seed)
+static void exchange_run(Exchange *x, int size)
 {
-    if (bee->target_flower == -1)
-    {
-        // Levy flight
-        if (random_float_r(seed, 0, 1) < 0.5f)
-        {
-            bee->position.x += random_float_r(seed, -BEE_SPEED, BEE_SPEED);
-            bee->position.y += random_float_r(seed, -BEE_SPEED, BEE_SPEED);
-        }
-        else
-        {
-            bee->position.x += random_float_r(seed, -BEE_SPEED * 10, BEE_SPEED * 10);
-            bee->position.y += random_float_r(seed, -BEE_SPEED * 10, BEE_SPEED * 10);
-        }
-
-        for (int i = 0; i < num_flowers; i++)
-        {
-            float dist = distance(bee->position, flowers[i].position);
-            if (dist < BEE_VISION_RANGE && flowers[i].nectar_available > 0)
-            {
-                bee->target_flower = i;
-                bee->nectar_found = flowers[i].nectar_available;
-                bee->state = RETURNING;
-                break;
-            }
-        }
-    }
+    exchange_layout(x, size);
 
-    bee->energy -= ENERGY_COST;
-}
-
-void returning_behavior(Bee *bee)
-{
-    Vector2D hive_pos = {HIVE_X, HIVE_Y};
-    move_towards(bee, hive_pos);
+    MPI_Alltoall(x->send_counts, 1, MPI_INT, x->recv_counts, 1, MPI_INT, MPI_COMM_WORLD);
 
-    float dist_to_hive = distance(bee->position, hive_pos);
-    if (dist_to_hive < HIVE_RADIUS)
+    int bytes = 0;
+    for (int r = 0; r < size; r++)
     {
-        bee->state = DANCING;
-        bee->dance_timer = DANCE_DURATION;
+        x->recv_displacements[r] = bytes;
+        bytes += x->recv_counts[r];
     }
-}
-
-void create_dance(Simulation *sim, Bee *bee)
-{
-    WaggleDance dance;
-    dance.bee_id = bee->id;
-    dance.flower_location = sim->flowers[bee->target_flower].position;
-    dance.nectar_quality = bee->nectar_found / FLOWER_NECTAR_MAX;
-
-    Vector2D hive_pos = {HIVE_X, HIVE_Y};
-    dance.distance_from_hive = distance(hive_pos, dance.flower_location);
-    dance.followers = 0;
+    x->recv = (char *)malloc((size_t)bytes + 1);
+    x->num_received = bytes / x->record_size;
 
-    sim->dances[sim->num_dances] = dance;
-    sim->num_dances++;
+    MPI_Alltoallv(x->send, x->send_counts, x->send_displacements, MPI_BYTE,
+                  x->recv, x->recv_counts, x->recv_displacements, MPI_BYTE,
+                  MPI_COMM_WORLD);
 }
 
-float calculate_dance_attractiveness(WaggleDance *dance)
+static void exchange_free(Exchange *x)
 {
-    float quality_factor = dance->nectar_quality * 2.0f;
-    float distance_penalty = 1.0f / (1.0f + dance->distance_from_hive / 100.0f);
-    float follower_bonus = 1.0f + (dance->followers * 0.1f);
-
-    return quality_factor * distance_penalty * follower_bonus;
+    free(x->send_counts);
+    free(x->send_displacements);
+    free(x->recv_counts);
+    free(x->recv_displacements);
+    free(x->fill);
+    free(x->send);
+    free(x->recv);
 }
 
-int choose_dance(Simulation *sim, unsigned int *seed)
+// Bees that flew out of this rank's strip are handed to the rank whose strip
+// they are in now. Each moving bee travels as one record: its id, then its
+// fields. Only movers are sent, so the traffic follows the boundary
+// crossings rather than the colony size.
+void migrate_bees(Simulation *sim, int rank, int size)
 {
-    if (sim->num_dances == 0)
-        return -1;
+    char *field[NUM_BEE_FIELDS];
+    int elem_size[NUM_BEE_FIELDS];
+    bee_fields(&sim->bees, field, elem_size);
 
-    float total_score = 0.0f;
-    for (int i = 0; i < sim->num_dances; i++)
+    int record_size = sizeof(int);
+    for (int f = 0; f < NUM_BEE_FIELDS; f++)
     {
-        total_score += calculate_dance_attractiveness(&sim->dances[i]);
+        record_size += elem_size[f];
     }
 
-    if (total_score < 0.0001f)
-        return -1;
-
-    float random_val = random_float_r(seed, 0, total_score);
-    float cumulative = 0.0f;
+    float lo, hi;
+    strip_bounds(rank, size, &lo, &hi);
+    int num_leaving;
+    const int *leaving = buckets_remove(&sim->buckets, sim->bees.x, lo, hi, &num_leaving);
+    int *dest = (int *)malloc((num_leaving + 1) * sizeof(int));
 
-    for (int i = 0; i < sim->num_dances; i++)
+    Exchange x;
+    exchange_init(&x, record_size, size);
+    for (int k = 0; k < num_leaving; k++)
     {
-        cumulative += calculate_dance_attractiveness(&sim->dances[i]);
-        if (random_val <= cumulative)
+        dest[k] = strip_owner(sim->bees.x[leaving[k]], size);
+        exchange_count(&x, dest[k]);
+    }
+    for (int k = 0; k < num_leaving; k++)
+    {
+        int i = leaving[k];
+        char *p = exchange_slot(&x, dest[k], size);
+
+        memcpy(p, &i, sizeof(int));
+        p += sizeof(int);
+        for (int f = 0; f < NUM_BEE_FIELDS; f++)
         {
-            return i;
+            memcpy(p, field[f] + (size_t)i * elem_size[f], elem_size[f]);
+            p += elem_size[f];
         }
     }
+    exchange_run(&x, size);
 
-    return sim->num_dances - 1;
-}
-
-void idle_bees_watch_dances(Simulation *sim, unsigned int *seed)
-{
-    for (int i = sim->bee_offset; i < sim->bee_offset + sim->num_local_bees; i++)
+    int *arrived = (int *)malloc((x.num_received + 1) * sizeof(int));
+    char *p = x.recv;
+    for (int k = 0; k < x.num_received; k++)
     {
-        Bee *bee = &sim->bees[i];
-
-        if (bee->state == IDLE && sim->num_dances > 0)
+        int i;
+        memcpy(&i, p, sizeof(int));
+        p += sizeof(int);
+        for (int f = 0; f < NUM_BEE_FIELDS; f++)
         {
-            if (random_float_r(seed, 0, 1) < DECISION_PROBABILITY)
-            {
-                int chosen_dance = choose_dance(sim, seed);
-
-                if (chosen_dance >= 0)
-                {
-                    bee->following_dance = chosen_dance;
-                    bee->state = FOLLOWER;
-                    sim->dances[chosen_dance].followers++;
-                    bee->target_location = sim->dances[chosen_dance].flower_location;
-
-                    int dancer_id = sim->dances[chosen_dance].bee_id;
-                    sim->bees[dancer_id].dance_followers++;
-                }
-            }
+            memcpy(field[f] + (size_t)i * elem_size[f], p, elem_size[f]);
+            p += elem_size[f];
         }
+        arrived[k] = i;
     }
+    buckets_add(&sim->buckets, sim->bees.state, arrived, x.num_received);
+
+    exchange_free(&x);
+    free(dest);
+    free(arrived);
 }
 
-void follower_behavior(Bee *bee, Simulation *sim)
+typedef struct
 {
-    Vector2D target = bee->target_location;
-    float dist = distance(bee->position, target);
-
-    move_towards(bee, target);
+    int id;
+    float x, y;
+    int state;
+} BeePosition;
+
+// Rank 0 collects the position and state of every bee for a trajectory frame.
+// Its arrays hold stale or unset values for bees it does not own, which nothing else
+// reads, so they can simply be overwritten. Its own parked bees must keep the
+// position they were parked at; trajectory_write places them.
+void gather_positions(Simulation *sim, int rank, int size)
+{
+    StateBuckets *b = &sim->buckets;
+    Calendar *c = &sim->calendar;
+    int num_owned = buckets_total(b) + (rank > 0 ? calendar_total(c) : 0);
+    BeePosition *send = (BeePosition *)malloc((num_owned + 1) * sizeof(BeePosition));
 
-    if (dist < 10.0f)
+    int n = 0;
+    for (int d = 0; rank > 0 && d < c->num_days; d++)
     {
-        bee->state = FORAGING;
-
-        for (int i = 0; i < NUM_FLOWERS; i++)
+        for (const CalendarChunk *chunk = c->first[d]; chunk; chunk = chunk->next)
         {
-            float flower_dist = distance(sim->flowers[i].position, target);
-            if (flower_dist < 20.0f)
+            for (int k = 0; k < chunk->count; k++)
             {
-                bee->target_flower = i;
-                break;
+                int i = chunk->bees[k].bee;
+                Vector2D pos = bee_position(&sim->bees, &chunk->bees[k], sim->timestep);
+                send[n].id = i;
+                send[n].x = pos.x;
+                send[n].y = pos.y;
+                send[n].state = sim->bees.state[i];
+                n++;
             }
         }
-
-        if (bee->target_flower == -1)
+    }
+    for (int s = 0; s < NUM_BEE_STATES; s++)
+    {
+        for (int k = 0; k < b->count[s]; k++)
         {
-            bee->state = RETURNING;
+            int i = b->ids[s][k];
+            send[n].id = i;
+            send[n].x = sim->bees.x[i];
+            send[n].y = sim->bees.y[i];
+            send[n].state = sim->bees.state[i];
+            n++;
         }
     }
 
-    if (bee->energy < MAX_ENERGY * 0.2f)
-    {
-        bee->state = RETURNING;
-        bee->target_flower = -1;
-    }
-}
+    int send_bytes = num_owned * sizeof(BeePosition);
+    int *byte_counts = (int *)malloc(size * sizeof(int));
+    int *byte_displacements = (int *)malloc(size * sizeof(int));
+    MPI_Gather(&send_bytes, 1, MPI_INT, byte_counts, 1, MPI_INT, 0, MPI_COMM_WORLD);
 
-void foraging_behavior(Bee *bee, Simulation *sim, float *local_nectar)
-{
-    if (bee->target_flower < 0)
+    int total_bytes = 0;
+    if (rank == 0)
     {
-        bee->state = IDLE;
-        return;
+        for (int r = 0; r < size; r++)
+        {
+            byte_displacements[r] = total_bytes;
+            total_bytes += byte_counts[r];
+        }
     }
 
-    Flower *flower = &sim->flowers[bee->target_flower];
+    BeePosition *recv = (BeePosition *)malloc((size_t)total_bytes + sizeof(BeePosition));
+    MPI_Gatherv(send, send_bytes, MPI_BYTE,
+                recv, byte_counts, byte_displacements, MPI_BYTE,
+                0, MPI_COMM_WORLD);
 
-    if (flower->bees_feeding < flower->capacity && flower->nectar_available > 0)
+    for (int k = 0; k < total_bytes / (int)sizeof(BeePosition); k++)
     {
-        flower->bees_feeding++;
-
-        float collected = fminf(10.0f, flower->nectar_available);
-        flower->nectar_available -= collected;
-
-        *local_nectar += collected;
-        bee->energy = fminf(MAX_ENERGY, bee->energy + collected * 0.5f);
+        int i = recv[k].id;
+        sim->bees.x[i] = recv[k].x;
+        sim->bees.y[i] = recv[k].y;
+        sim->bees.state[i] = (unsigned char)recv[k].state;
+    }
 
-        flower->bees_feeding--;
+    free(send);
+    free(recv);
+    free(byte_counts);
+    free(byte_displacements);
+}
 
-        bee->state = RETURNING;
-        bee->target_flower = -1;
-        bee->following_dance = -1;
-    }
-    else
+typedef struct
+{
+    int flower;
+    float nectar;
+} FlowerRecord;
+
+// Owners send the nectar of every flower that served a bee this step; the
+// others only regrow, which every rank computes for itself (flower_nectar).
+// The gather runs while the ranks watch dances, which never look at nectar.
+typedef struct
+{
+    FlowerRecord *send;
+    FlowerRecord *recv;
+    int *byte_counts;
+    int *byte_displacements;
+    int total;
+    MPI_Request request;
+} FlowerSync;
+
+// served is grouped by flower, as resolve_harvest leaves it
+void sync_flowers_begin(Simulation *sim, FlowerSync *fs, const HarvestDemand *served, int n, int size)
+{
+    fs->send = (FlowerRecord *)malloc((n + 1) * sizeof(FlowerRecord));
+    int num_changed = 0;
+    for (int k = 0; k < n; k++)
     {
-        if (bee->following_dance >= 0)
+        int i = served[k].flower;
+        if (served[k].collected > 0 && (num_changed == 0 || fs->send[num_changed - 1].flower != i))
         {
-            bee->state = RETURNING;
-            bee->target_flower = -1;
-            bee->following_dance = -1;
-        }
-        else
-        {
-            bee->state = SCOUT;
-            bee->target_flower = -1;
+            fs->send[num_changed].flower = i;
+            fs->send[num_changed].nectar = sim->flowers[i].nectar_available;
+            num_changed++;
         }
     }
-}
 
-MPI_Datatype create_bee_type()
-{
-    MPI_Datatype bee_type;
+    int send_bytes = num_changed * sizeof(FlowerRecord);
+    fs->byte_counts = (int *)malloc(size * sizeof(int));
+    fs->byte_displacements = (int *)malloc(size * sizeof(int));
+    MPI_Allgather(&send_bytes, 1, MPI_INT, fs->byte_counts, 1, MPI_INT, MPI_COMM_WORLD);
 
-    MPI_Type_contiguous(sizeof(Bee), MPI_BYTE, &bee_type);
-    MPI_Type_commit(&bee_type);
+    int bytes = 0;
+    for (int r = 0; r < size; r++)
+    {
+        fs->byte_displacements[r] = bytes;
+        bytes += fs->byte_counts[r];
+    }
+    fs->total = bytes / sizeof(FlowerRecord);
+    fs->recv = (FlowerRecord *)malloc((size_t)bytes + sizeof(FlowerRecord));
 
-    return bee_type;
+    MPI_Iallgatherv(fs->send, send_bytes, MPI_BYTE,
+                    fs->recv, fs->byte_counts, fs->byte_displacements, MPI_BYTE,
+                    MPI_COMM_WORLD, &fs->request);
 }
 
-void sync_bees(Simulation *sim, int rank, int size, MPI_Datatype bee_type)
+void sync_flowers_end(Simulation *sim, FlowerSync *fs)
 {
-    int *recvcounts = (int *)malloc(size * sizeof(int));
-    int *displacements = (int *)malloc(size * sizeof(int));
-
-    int bees_per_proc = NUM_BEES / size;
-    int remainder = NUM_BEES % size;
+    MPI_Wait(&fs->request, MPI_STATUS_IGNORE);
 
-    int offset = 0;
-    for (int i = 0; i < size; i++)
+    for (int k = 0; k < fs->total; k++)
     {
-        recvcounts[i] = bees_per_proc + (i < remainder ? 1 : 0);
-        displacements[i] = offset;
-        offset += recvcounts[i];
+        Flower *flower = &sim->flowers[fs->recv[k].flower];
+        flower->nectar_available = fs->recv[k].nectar;
+        flower->nectar_step = sim->timestep;
     }
 
-    MPI_Allgatherv(
-        sim->bees + sim->bee_offset,
-        sim->num_local_bees,
-        bee_type,
-        sim->bees,
-        recvcounts,
-        displacements,
-        bee_type,
-        MPI_COMM_WORLD);
-
-    free(recvcounts);
-    free(displacements);
+    free(fs->send);
+    free(fs->recv);
+    free(fs->byte_counts);
+    free(fs->byte_displacements);
 }
 
-void sync_flowers(Simulation *sim, int rank, int size)
+typedef struct
 {
-    float *local_nectar = (float *)malloc(NUM_FLOWERS * sizeof(float));
-    float *global_nectar = (float *)malloc(NUM_FLOWERS * sizeof(float));
+    int flower;
+    int bee;
+} DemandRecord;
 
-    for (int i = 0; i < NUM_FLOWERS; i++)
+typedef struct
+{
+    int bee;
+    float collected;
+} HarvestRecord;
+
+// Every demand is served by the rank that owns its flower, so each flower
+// is arbitrated in one place, in ascending bee id, within its capacity. The
+// collected amounts go back to the foragers' ranks, and the new nectar of
+// the served flowers to every rank (fs). Returns the nectar collected at
+// this rank's flowers.
+double serve_demands(Simulation *sim, int rank, int size, FlowerSync *fs)
+{
+    Exchange out;
+    exchange_init(&out, sizeof(DemandRecord), size);
+    for (int k = 0; k < sim->num_demands; k++)
     {
-        local_nectar[i] = sim->flowers[i].nectar_available;
+        Flower *flower = &sim->flowers[sim->demands[k].flower];
+        exchange_count(&out, strip_owner(flower->position.x, size));
     }
+    for (int k = 0; k < sim->num_demands; k++)
+    {
+        Flower *flower = &sim->flowers[sim->demands[k].flower];
+        DemandRecord d = {sim->demands[k].flower, sim->demands[k].bee};
+        memcpy(exchange_slot(&out, strip_owner(flower->position.x, size), size), &d, sizeof(d));
+    }
+    exchange_run(&out, size);
 
-    MPI_Allreduce(local_nectar, global_nectar, NUM_FLOWERS, MPI_FLOAT, MPI_MIN, MPI_COMM_WORLD);
-
-    for (int i = 0; i < NUM_FLOWERS; i++)
+    int num_served = out.num_received;
+    HarvestDemand *served = (HarvestDemand *)malloc((num_served + 1) * sizeof(HarvestDemand));
+    for (int r = 0, k = 0; r < size; r++)
     {
-        sim->flowers[i].nectar_available = global_nectar[i];
+        for (int j = 0; j < out.recv_counts[r] / out.record_size; j++, k++)
+        {
+            DemandRecord d;
+            memcpy(&d, out.recv + (size_t)k * sizeof(d), sizeof(d));
+            served[k].flower = d.flower;
+            served[k].bee = d.bee;
+            served[k].rank = r;
+        }
     }
+    exchange_free(&out);
 
-    free(local_nectar);
-    free(global_nectar);
-}
+    double nectar = resolve_harvest(sim, served, num_served);
+    sync_flowers_begin(sim, fs, served, num_served, size);
 
-void sync_dances(Simulation *sim, int rank, int size)
-{
-    int *dance_counts = (int *)malloc(size * sizeof(int));
-    MPI_Allgather(&sim->num_dances, 1, MPI_INT, dance_counts, 1, MPI_INT, MPI_COMM_WORLD);
-
-    int *displacements = (int *)malloc(size * sizeof(int));
-    int total_dances = 0;
-    for (int i = 0; i < size; i++)
+    Exchange back;
+    exchange_init(&back, sizeof(HarvestRecord), size);
+    for (int k = 0; k < num_served; k++)
     {
-        displacements[i] = total_dances;
-        total_dances += dance_counts[i];
+        exchange_count(&back, served[k].rank);
     }
-
-    if (total_dances == 0)
+    for (int k = 0; k < num_served; k++)
     {
-        sim->num_dances = 0;
-        free(dance_counts);
-        free(displacements);
-        return;
+        HarvestRecord h = {served[k].bee, served[k].collected};
+        memcpy(exchange_slot(&back, served[k].rank, size), &h, sizeof(h));
     }
+    exchange_run(&back, size);
 
-    WaggleDance *all_dances = (WaggleDance *)malloc(total_dances * sizeof(WaggleDance));
-
-    int *byte_counts = (int *)malloc(size * sizeof(int));
-    int *byte_displacements = (int *)malloc(size * sizeof(int));
-    for (int i = 0; i < size; i++)
+    // every demand of this rank comes back exactly once
+    for (int k = 0; k < back.num_received; k++)
     {
-        byte_counts[i] = dance_counts[i] * sizeof(WaggleDance);
-        byte_displacements[i] = displacements[i] * sizeof(WaggleDance);
+        HarvestRecord h;
+        memcpy(&h, back.recv + (size_t)k * sizeof(h), sizeof(h));
+        sim->demands[k].bee = h.bee;
+        sim->demands[k].collected = h.collected;
     }
+    apply_harvest(sim, sim->demands, back.num_received);
 
-    MPI_Allgatherv(
-        sim->dances,
-        sim->num_dances * sizeof(WaggleDance),
-        MPI_BYTE,
-        all_dances,
-        byte_counts,
-        byte_displacements,
-        MPI_BYTE,
-        MPI_COMM_WORLD);
-
-    memcpy(sim->dances, all_dances, total_dances * sizeof(WaggleDance));
-    sim->num_dances = total_dances;
-
-    free(dance_counts);
-    free(displacements);
-    free(byte_counts);
-    free(byte_displacements);
-    free(all_dances);
+    exchange_free(&back);
+    free(served);
+    return nectar;
 }
 
-void update_local_bees(Simulation *sim, unsigned int *seed, float *local_nectar)
+typedef struct
+{
+    int *byte_counts;
+    int *byte_displacements;
+    int total;
+    WaggleDance *all;
+    MPI_Request request;
+} DanceSync;
+
+void sync_dances_begin(Simulation *sim, DanceSync *ds, int rank, int size)
 {
-    for (int i = sim->bee_offset; i < sim->bee_offset + sim->num_local_bees; i++)
+    for (int c = 0; c < sim->num_dances; c++)
     {
-        Bee *bee = &sim->bees[i];
-
-        switch (bee->state)
-        {
-        case SCOUT:
-            scout_behavior(bee, sim->flowers, NUM_FLOWERS, seed);
-            break;
-
-        case RETURNING:
-            returning_behavior(bee);
-
-            if (bee->state == DANCING && bee->dance_timer == DANCE_DURATION)
-            {
-                create_dance(sim, bee);
-            }
-            break;
+        sim->dances[c].owner = rank;
+    }
 
-        case DANCING:
-            bee->dance_timer--;
-            if (bee->dance_timer <= 0)
-            {
-                if (bee->dance_followers > 0)
-                {
-                    bee->state = FORAGING;
-                }
-                else
-                {
-                    bee->state = IDLE;
-                    bee->target_flower = -1;
-                }
-                bee->dance_followers = 0;
-            }
-            break;
+    int *dance_counts = (int *)malloc(size * sizeof(int));
+    MPI_Allgather(&sim->num_dances, 1, MPI_INT, dance_counts, 1, MPI_INT, MPI_COMM_WORLD);
 
-        case IDLE:
-            break;
+    ds->byte_counts = (int *)malloc(size * sizeof(int));
+    ds->byte_displacements = (int *)malloc(size * sizeof(int));
+    ds->total = 0;
+    for (int i = 0; i < size; i++)
+    {
+        ds->byte_counts[i] = dance_counts[i] * sizeof(WaggleDance);
+        ds->byte_displacements[i] = ds->total * sizeof(WaggleDance);
+        ds->total += dance_counts[i];
+    }
+    free(dance_counts);
 
-        case FOLLOWER:
-            follower_behavior(bee, sim);
-            break;
+    ds->all = (WaggleDance *)malloc((ds->total + 1) * sizeof(WaggleDance));
+    MPI_Iallgatherv(sim->dances, sim->num_dances * sizeof(WaggleDance), MPI_BYTE,
+                    ds->all, ds->byte_counts, ds->byte_displacements, MPI_BYTE,
+                    MPI_COMM_WORLD, &ds->request);
+}
 
-        case FORAGING:
-            foraging_behavior(bee, sim, local_nectar);
-            break;
-        }
+void sync_dances_end(Simulation *sim, DanceSync *ds)
+{
+    MPI_Wait(&ds->request, MPI_STATUS_IGNORE);
 
-        if (bee->energy <= 0)
-        {
-            Vector2D hive_pos = {HIVE_X, HIVE_Y};
-            float dist = distance(bee->position, hive_pos);
+    reserve_dances(sim, ds->total);
+    if (ds->total > 0)
+        memcpy(sim->dances, ds->all, ds->total * sizeof(WaggleDance));
+    sim->num_dances = ds->total;
 
-            if (dist < HIVE_RADIUS)
-            {
-                bee->energy = MAX_ENERGY;
-                bee->state = IDLE;
-            }
-            else
-            {
-                bee->state = RETURNING;
-                bee->target_flower = -1;
-            }
-        }
+    // each rank's block is sorted already; merge them into bee id order
+    sort_dances(sim);
 
-        if (bee->position.x < 0)
-            bee->position.x = 0;
-        if (bee->position.x > WORLD_SIZE)
-            bee->position.x = WORLD_SIZE;
-        if (bee->position.y < 0)
-            bee->position.y = 0;
-        if (bee->position.y > WORLD_SIZE)
-            bee->position.y = WORLD_SIZE;
-    }
+    free(ds->all);
+    free(ds->byte_counts);
+    free(ds->byte_displacements);
 }
 
-void update_flowers(Simulation *sim)
+// idle_bees_watch_dances credits recruits to the dancer's entry on the rank
+// that watched, which is stale when another rank owns the dancer. Those
+// counts go to the owner as one (bee id, followers) pair per dance.
+void send_followers(Simulation *sim, int rank, int size)
 {
-    for (int i = 0; i < NUM_FLOWERS; i++)
+    Exchange x;
+    exchange_init(&x, 2 * sizeof(int), size);
+    for (int c = 0; c < sim->num_dances; c++)
     {
-        if (sim->flowers[i].nectar_available < sim->flowers[i].nectar_total)
+        WaggleDance *d = &sim->dances[c];
+        if (d->followers > 0 && d->owner != rank)
+            exchange_count(&x, d->owner);
+    }
+    for (int c = 0; c < sim->num_dances; c++)
+    {
+        WaggleDance *d = &sim->dances[c];
+        if (d->followers > 0 && d->owner != rank)
         {
-            sim->flowers[i].nectar_available += NECTAR_REGEN_RATE;
-            if (sim->flowers[i].nectar_available > sim->flowers[i].nectar_total)
-            {
-                sim->flowers[i].nectar_available = sim->flowers[i].nectar_total;
-            }
+            int pair[2] = {d->bee_id, d->followers};
+            memcpy(exchange_slot(&x, d->owner, size), pair, sizeof(pair));
         }
     }
-}
+    exchange_run(&x, size);
 
-void simulation_step(Simulation *sim, int rank, int size, MPI_Datatype bee_type, unsigned int *seed)
-{
-    float local_nectar = 0.0f;
+    for (int k = 0; k < x.num_received; k++)
+    {
+        int pair[2];
+        memcpy(pair, x.recv + (size_t)k * sizeof(pair), sizeof(pair));
+        sim->bees.dance_followers[pair[0]] += pair[1];
+    }
 
-    update_local_bees(sim, seed, &local_nectar);
+    exchange_free(&x);
+}
 
-    sync_bees(sim, rank, size, bee_type);
+// Colony-wide bees per state after the last step, from the same reduction as
+// the nectar total
+static int colony_counts[NUM_BEE_STATES];
 
-    sync_dances(sim, rank, size);
+// Flowers are replicated on every rank, so they double as the halo for
+// vision lookups near a strip edge. Each flower is harvested only by its
+// owner, the others receive its new nectar. Collectives are
+// started as soon as their inputs are final and waited for only when a
+// later phase needs the result.
+void simulation_step(Simulation *sim, int rank, int size, Bench *bench)
+{
+    update_bees(sim);
+    bench_lap(bench, PHASE_UPDATE_BEES);
+
+    DanceSync dance_sync;
+    sync_dances_begin(sim, &dance_sync, rank, size);
+
+    FlowerSync flower_sync;
+    double local_nectar = serve_demands(sim, rank, size, &flower_sync);
+    bench_lap(bench, PHASE_HARVEST);
+
+    sync_dances_end(sim, &dance_sync);
+    bench_lap(bench, PHASE_SYNC_DANCES);
+
+    idle_bees_watch_dances(sim);
+    bench_lap(bench, PHASE_WATCH_DANCES);
+
+    // states are final for this step (migration only moves bees between
+    // ranks), so the nectar total and the state counts go out together and
+    // overlap the exchanges below
+    double totals[1 + NUM_BEE_STATES];
+    double global_totals[1 + NUM_BEE_STATES];
+    int count[NUM_BEE_STATES];
+    bee_counts(sim, count);
+    MPI_Request totals_request;
+    totals[0] = local_nectar;
+    for (int s = 0; s < NUM_BEE_STATES; s++)
+    {
+        totals[1 + s] = count[s];
+    }
+    MPI_Iallreduce(totals, global_totals, 1 + NUM_BEE_STATES, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD,
+                   &totals_request);
 
-    idle_bees_watch_dances(sim, seed);
+    send_followers(sim, rank, size);
+    bench_lap(bench, PHASE_SEND_FOLLOWERS);
 
-    sync_bees(sim, rank, size, bee_type);
+    sync_flowers_end(sim, &flower_sync);
+    bench_lap(bench, PHASE_SYNC_FLOWERS);
 
-    sync_flowers(sim, rank, size);
+    migrate_bees(sim, rank, size);
+    bench_lap(bench, PHASE_MIGRATE_BEES);
 
-    if (rank == 0)
+    MPI_Wait(&totals_request, MPI_STATUS_IGNORE);
+    sim->total_nectar_collected += global_totals[0];
+    for (int s = 0; s < NUM_BEE_STATES; s++)
     {
-        update_flowers(sim);
+        colony_counts[s] = (int)global_totals[1 + s];
     }
-    MPI_Bcast(sim->flowers, NUM_FLOWERS * sizeof(Flower), MPI_BYTE, 0, MPI_COMM_WORLD);
-
-    float global_nectar;
-    MPI_Allreduce(&local_nectar, &global_nectar, 1, MPI_FLOAT, MPI_SUM, MPI_COMM_WORLD);
-    sim->total_nectar_collected += global_nectar;
 
     sim->num_dances = 0;
     sim->timestep++;
+    bench_lap(bench, PHASE_REDUCE_TOTALS);
 }
 
-void print_statistics(Simulation *sim, int rank)
+// create_simulation on every rank; NULL on all of them if any rank failed
+static Simulation *create_on_all_ranks(int rank, int size)
 {
-    if (rank != 0)
-        return;
+    Simulation *sim = create_simulation(rank, size);
+    int ok = sim != NULL;
+    MPI_Allreduce(MPI_IN_PLACE, &ok, 1, MPI_INT, MPI_MIN, MPI_COMM_WORLD);
+    if (!ok && sim)
+    {
+        destroy_simulation(sim);
+        sim = NULL;
+    }
+    return sim;
+}
 
-    int scouts = 0, idle = 0, dancing = 0, followers = 0, foraging = 0, returning = 0;
+// Each repetition starts from the same fresh world. Every
+// sample is reduced to the slowest rank before rank 0 reports; the peak
+// memory is the sum over the ranks.
+static void run_benchmark(int rank, int size, int num_threads)
+{
+    Bench bench;
+    bench_init(&bench, phase_names, NUM_PHASES, run_config.bench_repeats, run_config.max_timesteps);
 
-    for (int i = 0; i < NUM_BEES; i++)
+    for (int r = 0; r < run_config.bench_repeats; r++)
     {
-        switch (sim->bees[i].state)
+        Simulation *sim = create_on_all_ranks(rank, size);
+        if (!sim)
+        {
+            bench_free(&bench);
+            return;
+        }
+
+        for (int t = 0; t < run_config.bench_warmup; t++)
+        {
+            simulation_step(sim, rank, size, NULL);
+        }
+
+        MPI_Barrier(MPI_COMM_WORLD);
+        for (int t = 0; t < run_config.max_timesteps; t++)
         {
-        case SCOUT:
-            scouts++;
-            break;
-        case IDLE:
-            idle++;
-            break;
-        case DANCING:
-            dancing++;
-            break;
-        case FOLLOWER:
-            followers++;
-            break;
-        case FORAGING:
-            foraging++;
-            break;
-        case RETURNING:
-            returning++;
-            break;
+            bench_step_begin(&bench);
+            simulation_step(sim, rank, size, &bench);
+            bench_step_end(&bench);
         }
+
+        destroy_simulation(sim);
     }
 
-    printf("Step %4d | Nectar: %7.2f | Scout: %3d | Idle: %3d | Dance: %3d | Follow: %3d | Forage: %3d | Return: %3d\n",
-           sim->timestep, sim->total_nectar_collected, scouts, idle, dancing, followers, foraging, returning);
+    int count = (NUM_PHASES + 1) * bench.num_reps * bench.steps_per_rep;
+    double *samples = bench_samples(&bench, 0);
+    MPI_Reduce(rank == 0 ? MPI_IN_PLACE : samples, samples, count, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+    double peak_mb = bench_peak_memory();
+    MPI_Reduce(&peak_mb, &bench.peak_memory_mb, 1, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+
+    if (rank == 0)
+    {
+        bench_report(&bench, TARGET_NAME, size * num_threads, run_config.bench_warmup,
+                     "bench_" TARGET_NAME ".json");
+    }
+    bench_free(&bench);
 }
 
 int main(int argc, char **argv)
 {
-    MPI_Init(&argc, &argv);
-
     int rank, size;
+    int num_threads = 1;
+#ifdef _OPENMP
+    int provided;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+    if (provided < MPI_THREAD_FUNNELED)
+    {
+        if (rank == 0)
+            printf("Error: the MPI library does not support MPI_THREAD_FUNNELED\n");
+        MPI_Finalize();
+        return 1;
+    }
+    num_threads = omp_get_max_threads();
+#else
+    MPI_Init(&argc, &argv);
     MPI_Comm_rank(MPI_COMM_WORLD, &rank);
     MPI_Comm_size(MPI_COMM_WORLD, &size);
+#endif
+
+    // every rank parses the same arguments, so they all agree on the outcome
+    argc = config_parse_args(argc, argv, rank == 0);
+    if (argc <= 0)
+    {
+        MPI_Finalize();
+        return argc < 0;
+    }
 
     if (rank == 0)
     {
-        printf("=== Bee Foraging Simulation (MPI) ===\n");
+        printf("=== Bee Foraging Simulation (" TARGET_TITLE ") ===\n");
         printf("Configuration:\n");
         printf("  MPI Processes: %d\n", size);
-        printf("  World size: %.0fx%.0f\n", WORLD_SIZE, WORLD_SIZE);
-        printf("  Bees: %d (%.0f%% scouts)\n", NUM_BEES, SCOUT_RATIO * 100);
-        printf("  Flowers: %d\n", NUM_FLOWERS);
-        printf("  Timesteps: %d\n\n", MAX_TIMESTEPS);
+#ifdef _OPENMP
+        printf("  Threads per process: %d\n", num_threads);
+#endif
+        printf("  World size: %.0fx%.0f\n", sim_config.world_size, sim_config.world_size);
+        printf("  Bees: %d (%.0f%% scouts)\n", sim_config.num_bees, sim_config.scout_ratio * 100);
+        printf("  Flowers: %d\n", sim_config.num_flowers);
+        printf("  Flower scan: %s\n", flower_scan_name(flower_scan_select()));
+        printf("  Bee kernels: %s\n", bee_kernels_select().name);
+        printf("  Timesteps: %d\n\n", run_config.max_timesteps);
     }
 
-    Simulation *sim = create_simulation(rank, size);
+    if (run_config.bench_repeats > 0)
+    {
+        run_benchmark(rank, size, num_threads);
+        MPI_Finalize();
+        return 0;
+    }
+
+    Simulation *sim = create_on_all_ranks(rank, size);
+    if (!sim)
+    {
+        MPI_Finalize();
+        return 1;
+    }
 
-    unsigned int seed = rank * 1000;
+    // every rank reads its own file; all of them must load, and at one step
+    const char *restart = config_restart_path();
+    if (restart)
+    {
+        int status = checkpoint_load(sim, restart, rank, size);
+        int steps[2] = {sim->timestep, -sim->timestep};
+        MPI_Allreduce(MPI_IN_PLACE, &status, 1, MPI_INT, MPI_MIN, MPI_COMM_WORLD);
+        MPI_Allreduce(MPI_IN_PLACE, steps, 2, MPI_INT, MPI_MIN, MPI_COMM_WORLD);
+        if (status == 0 && steps[0] != -steps[1])
+        {
+            if (rank == 0)
+                printf("Error: the files of %s are from different steps\n", restart);
+            status = -1;
+        }
+        if (status != 0)
+        {
+            destroy_simulation(sim);
+            MPI_Finalize();
+            return 1;
+        }
+        if (rank == 0)
+            printf("Restarted from %s at step %d\n\n", restart, sim->timestep);
+    }
+    int first_step = sim->timestep;
 
-    MPI_Datatype bee_type = create_bee_type();
+    // every rank holds only its own strip, so each frame, the first one
+    // included, needs the bees gathered from all strips
+    TrajectoryWriter trajectory;
+    int every = run_config.trajectory_every;
+    if (every > 0)
+    {
+        gather_positions(sim, rank, size);
+    }
+    if (every > 0 && rank == 0)
+    {
+        trajectory_open(&trajectory, "positions.bin", sim);
+        trajectory_write(&trajectory, sim);
+    }
 
     MPI_Barrier(MPI_COMM_WORLD);
     double start = MPI_Wtime();
 
-    for (int t = 0; t < MAX_TIMESTEPS; t++)
+    for (int t = first_step; t < run_config.max_timesteps; t++)
     {
-        simulation_step(sim, rank, size, bee_type, &seed);
+        simulation_step(sim, rank, size, NULL);
 
-        // if (t % 1000 == 0)
-        // {
-        //     print_statistics(sim, rank);
-        // }
+        if (every > 0 && sim->timestep % every == 0)
+        {
+            gather_positions(sim, rank, size);
+            if (rank == 0)
+            {
+                trajectory_write(&trajectory, sim);
+            }
+        }
+
+        // each rank writes its own file, all at once
+        if (run_config.checkpoint_every > 0 && sim->timestep % run_config.checkpoint_every == 0)
+        {
+            checkpoint_save(sim, CHECKPOINT_FILE, rank, size);
+        }
+
+        if (run_config.stats_every > 0 && sim->timestep % run_config.stats_every == 0 && rank == 0)
+        {
+            print_statistics(sim, colony_counts);
+        }
     }
 
     MPI_Barrier(MPI_COMM_WORLD);
@@ -648,10 +778,14 @@ int main(int argc, char **argv)
         printf("\n=== Final Results ===\n");
         printf("Total nectar collected: %.2f\n", sim->total_nectar_collected);
         printf("Execution time: %.3f seconds\n", elapsed);
-        printf("Throughput: %.2f timesteps/sec\n", MAX_TIMESTEPS / elapsed);
+        printf("Throughput: %.2f timesteps/sec\n", (run_config.max_timesteps - first_step) / elapsed);
+    }
+
+    if (every > 0 && rank == 0)
+    {
+        trajectory_close(&trajectory);
     }
 
-    MPI_Type_free(&bee_type);
     destroy_simulation(sim);
     MPI_Finalize();
 
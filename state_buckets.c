@@ -0,0 +1,117 @@
+#include <stdlib.h>
+#include "state_buckets.h"
+
+static void reserve(int **ids, int *capacity, int needed)
+{
+    if (needed <= *capacity)
+        return;
+
+    int grown = *capacity * 2 > needed ? *capacity * 2 : needed;
+    *ids = (int *)realloc(*ids, (size_t)grown * sizeof(int));
+    *capacity = grown;
+}
+
+void buckets_build(StateBuckets *b, const unsigned char *state, const int *ids, int n)
+{
+    for (int s = 0; s < NUM_BEE_STATES; s++)
+    {
+        b->ids[s] = NULL;
+        b->count[s] = 0;
+        b->capacity[s] = 0;
+    }
+    b->movers = NULL;
+    b->movers_capacity = 0;
+
+    buckets_add(b, state, ids, n);
+}
+
+void buckets_free(StateBuckets *b)
+{
+    for (int s = 0; s < NUM_BEE_STATES; s++)
+    {
+        free(b->ids[s]);
+        b->ids[s] = NULL;
+        b->count[s] = 0;
+        b->capacity[s] = 0;
+    }
+    free(b->movers);
+    b->movers = NULL;
+    b->movers_capacity = 0;
+}
+
+int buckets_total(const StateBuckets *b)
+{
+    int total = 0;
+    for (int s = 0; s < NUM_BEE_STATES; s++)
+    {
+        total += b->count[s];
+    }
+    return total;
+}
+
+void buckets_add(StateBuckets *b, const unsigned char *state, const int *ids, int n)
+{
+    for (int k = 0; k < n; k++)
+    {
+        int i = ids[k];
+        int s = state[i];
+        reserve(&b->ids[s], &b->capacity[s], b->count[s] + 1);
+        b->ids[s][b->count[s]++] = i;
+    }
+}
+
+const int *buckets_remove(StateBuckets *b, const float *x, float x_lo, float x_hi, int *n)
+{
+    int removed = 0;
+    reserve(&b->movers, &b->movers_capacity, buckets_total(b));
+    int *out = b->movers;
+    for (int s = 0; s < NUM_BEE_STATES; s++)
+    {
+        int *ids = b->ids[s];
+        int kept = 0;
+        for (int k = 0; k < b->count[s]; k++)
+        {
+            int i = ids[k];
+            if (x[i] < x_lo || x[i] >= x_hi)
+                out[removed++] = i;
+            else
+                ids[kept++] = i;
+        }
+        b->count[s] = kept;
+    }
+    *n = removed;
+    return out;
+}
+
+void buckets_refresh(StateBuckets *b, const unsigned char *state, const int *scanned)
+{
+    int num_movers = 0;
+    reserve(&b->movers, &b->movers_capacity, buckets_total(b));
+
+    // compact first, so appends below never land in a range still being scanned
+    for (int s = 0; s < NUM_BEE_STATES; s++)
+    {
+        if (scanned[s] == 0)
+            continue;
+
+        int *ids = b->ids[s];
+        int kept = 0;
+        for (int k = 0; k < scanned[s]; k++)
+        {
+            int i = ids[k];
+            if (state[i] == s)
+                ids[kept++] = i;
+            else
+                b->movers[num_movers++] = i;
+        }
+
+        // entries past the scanned prefix are kept as they are
+        for (int k = scanned[s]; k < b->count[s]; k++)
+        {
+            ids[kept++] = ids[k];
+        }
+        b->count[s] = kept;
+    }
+
+    buckets_add(b, state, b->movers, num_movers);
+}
@@ -0,0 +1,24 @@
+#ifndef STATE_BUCKETS_H
+#define STATE_BUCKETS_H
+#include "types.h"
+
+// Per-state lists of the bee indices this process owns. Behaviors run over
+// one list at a time; bees that changed state are moved between lists
+// afterwards. Lists grow as needed, since under MPI bees migrate in and out.
+void buckets_build(StateBuckets *b, const unsigned char *state, const int *ids, int n);
+void buckets_free(StateBuckets *b);
+int buckets_total(const StateBuckets *b);
+
+// Appends ids to the buckets of their current state
+void buckets_add(StateBuckets *b, const unsigned char *state, const int *ids, int n);
+// Drops every bee whose x lies outside [x_lo, x_hi), keeping the others in
+// order. Returns the n dropped ids, in the movers scratch, which stays valid
+// until the next buckets_remove or buckets_refresh.
+const int *buckets_remove(StateBuckets *b, const float *x, float x_lo, float x_hi, int *n);
+
+// Re-files bees among the first scanned[s] entries of each bucket whose
+// state is no longer s. Order inside a bucket is kept stable and movers are
+// appended in scan order, so the lists stay deterministic.
+void buckets_refresh(StateBuckets *b, const unsigned char *state, const int *scanned);
+
+#endif
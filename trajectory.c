@@ -0,0 +1,235 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include "trajectory.h"
+#include "bee_core.h"
+#include "sim_config.h"
+
+static uint64_t frame_pad(int num_bees)
+{
+    return (4 - (uint64_t)num_bees % 4) % 4;
+}
+
+static uint64_t frame_size(int num_bees, int num_flowers)
+{
+    return sizeof(int32_t) + (uint64_t)num_bees * (2 * sizeof(float) + 1) + frame_pad(num_bees) +
+           (uint64_t)num_flowers * sizeof(float);
+}
+
+// writev until every byte is out; iov is consumed in place
+static int write_all(int fd, struct iovec *iov, int iovcnt)
+{
+    while (iovcnt > 0)
+    {
+        ssize_t written = writev(fd, iov, iovcnt);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+
+        while (iovcnt > 0 && (size_t)written >= iov->iov_len)
+        {
+            written -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0)
+        {
+            iov->iov_base = (char *)iov->iov_base + written;
+            iov->iov_len -= written;
+        }
+    }
+    return 0;
+}
+
+static void report_error(TrajectoryWriter *w, const char *what)
+{
+    printf("Error: %s %s: %s\n", what, w->path, strerror(errno));
+}
+
+static void *writer_thread(void *arg)
+{
+    TrajectoryWriter *w = (TrajectoryWriter *)arg;
+
+    pthread_mutex_lock(&w->lock);
+    for (;;)
+    {
+        while (w->count == 0 && !w->closing)
+        {
+            pthread_cond_wait(&w->changed, &w->lock);
+        }
+        if (w->count == 0)
+            break;
+
+        // the producer never touches a queued buffer, so write it unlocked
+        char *frame = w->buffers[w->head];
+        int failed = w->failed;
+        pthread_mutex_unlock(&w->lock);
+
+        if (!failed)
+        {
+            struct iovec iov = {frame, w->frame_size};
+            if (write_all(w->fd, &iov, 1) != 0)
+            {
+                report_error(w, "cannot write");
+                failed = 1;
+            }
+        }
+
+        pthread_mutex_lock(&w->lock);
+        w->failed = failed;
+        w->frames += !failed;
+        w->head = (w->head + 1) % w->num_buffers;
+        w->count--;
+        pthread_cond_broadcast(&w->changed);
+    }
+    pthread_mutex_unlock(&w->lock);
+    return NULL;
+}
+
+int trajectory_open(TrajectoryWriter *w, const char *path, Simulation *sim)
+{
+    w->path = path;
+    w->num_bees = sim_config.num_bees;
+    w->num_flowers = sim_config.num_flowers;
+    w->frame_size = frame_size(w->num_bees, w->num_flowers);
+    w->num_buffers = run_config.trajectory_buffers;
+    w->drop_when_full = run_config.trajectory_drop;
+    w->buffers = NULL;
+    w->head = w->count = 0;
+    w->closing = 0;
+    w->failed = 0;
+    w->frames = w->dropped = 0;
+
+    w->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (w->fd < 0)
+    {
+        report_error(w, "cannot create");
+        return -1;
+    }
+
+    TrajectoryHeader h;
+    memset(&h, 0, sizeof(h));
+    strcpy(h.magic, TRAJECTORY_MAGIC);
+    h.version = TRAJECTORY_VERSION;
+    h.header_size = sizeof(TrajectoryHeader);
+    h.num_bees = w->num_bees;
+    h.num_flowers = w->num_flowers;
+    h.world_size = sim_config.world_size;
+    h.hive_radius = sim_config.hive_radius;
+    h.frame_size = w->frame_size;
+    h.frames_offset = sizeof(TrajectoryHeader) + 2 * (uint64_t)w->num_flowers * sizeof(float);
+
+    float *flower_xy = (float *)malloc((2 * (size_t)w->num_flowers + 1) * sizeof(float));
+    for (int i = 0; i < w->num_flowers; i++)
+    {
+        flower_xy[i] = sim->flowers[i].position.x;
+        flower_xy[w->num_flowers + i] = sim->flowers[i].position.y;
+    }
+
+    struct iovec iov[2] = {
+        {&h, sizeof(h)},
+        {flower_xy, 2 * (size_t)w->num_flowers * sizeof(float)},
+    };
+    int status = write_all(w->fd, iov, 2);
+    free(flower_xy);
+
+    if (status != 0)
+    {
+        report_error(w, "cannot write");
+        close(w->fd);
+        w->fd = -1;
+        return -1;
+    }
+
+    w->buffers = (char **)malloc(w->num_buffers * sizeof(char *));
+    for (int b = 0; b < w->num_buffers; b++)
+    {
+        // zeroed once, so the padding bytes stay zero
+        w->buffers[b] = (char *)calloc(w->frame_size, 1);
+    }
+
+    pthread_mutex_init(&w->lock, NULL);
+    pthread_cond_init(&w->changed, NULL);
+    pthread_create(&w->thread, NULL, writer_thread, w);
+    return 0;
+}
+
+int trajectory_write(TrajectoryWriter *w, Simulation *sim)
+{
+    if (w->fd < 0)
+        return -1;
+
+    pthread_mutex_lock(&w->lock);
+    while (w->count == w->num_buffers && !w->failed && !w->drop_when_full)
+    {
+        pthread_cond_wait(&w->changed, &w->lock);
+    }
+    if (w->failed || w->count == w->num_buffers)
+    {
+        int status = w->failed ? -1 : 1;
+        w->dropped += status > 0;
+        pthread_mutex_unlock(&w->lock);
+        return status;
+    }
+    char *frame = w->buffers[(w->head + w->count) % w->num_buffers];
+    pthread_mutex_unlock(&w->lock);
+
+    // serialize the frame; the writer thread is busy with other buffers
+    size_t nb = (size_t)w->num_bees;
+    int32_t timestep = sim->timestep;
+    char *p = frame;
+    memcpy(p, &timestep, sizeof(timestep));
+    p += sizeof(timestep);
+    float *x = (float *)p;
+    memcpy(x, sim->bees.x, nb * sizeof(float));
+    p += nb * sizeof(float);
+    float *y = (float *)p;
+    memcpy(y, sim->bees.y, nb * sizeof(float));
+    p += nb * sizeof(float);
+    parked_positions(sim, x, y);
+    memcpy(p, sim->bees.state, nb);
+    p += nb + frame_pad(w->num_bees);
+
+    float *nectar = (float *)p;
+    for (int i = 0; i < w->num_flowers; i++)
+    {
+        nectar[i] = flower_nectar(&sim->flowers[i], sim->timestep);
+    }
+
+    pthread_mutex_lock(&w->lock);
+    w->count++;
+    pthread_cond_broadcast(&w->changed);
+    pthread_mutex_unlock(&w->lock);
+    return 0;
+}
+
+void trajectory_close(TrajectoryWriter *w)
+{
+    if (w->fd < 0)
+        return;
+
+    pthread_mutex_lock(&w->lock);
+    w->closing = 1;
+    pthread_cond_broadcast(&w->changed);
+    pthread_mutex_unlock(&w->lock);
+    pthread_join(w->thread, NULL);
+
+    close(w->fd);
+    w->fd = -1;
+    printf("Trajectory saved to %s (%d frames, %d dropped)\n", w->path, w->frames, w->dropped);
+
+    for (int b = 0; b < w->num_buffers; b++)
+    {
+        free(w->buffers[b]);
+    }
+    free(w->buffers);
+    pthread_mutex_destroy(&w->lock);
+    pthread_cond_destroy(&w->changed);
+}
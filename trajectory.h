@@ -0,0 +1,77 @@
+#ifndef TRAJECTORY_H
+#define TRAJECTORY_H
+#include <stdint.h>
+#include <pthread.h>
+#include "types.h"
+
+// Binary trajectory file (positions.bin), read by visualize.py.
+// All values are little-endian. Layout:
+//
+//   TrajectoryHeader                 64 bytes
+//   float flower_x[num_flowers]      flowers never move, so written once
+//   float flower_y[num_flowers]
+//   frame * N, each frame_size bytes:
+//     int32_t timestep
+//     float   x[num_bees]
+//     float   y[num_bees]
+//     uint8_t state[num_bees]        BeeState
+//     uint8_t pad[]                  to a multiple of 4 bytes
+//     float   nectar[num_flowers]    nectar_available
+//
+// Frames have a fixed size, so a reader can memory-map the file and index
+// frame t directly.
+
+#define TRAJECTORY_MAGIC "BEETRAJ"
+#define TRAJECTORY_VERSION 1
+
+typedef struct
+{
+    char magic[8]; // TRAJECTORY_MAGIC, NUL-terminated
+    uint32_t version;
+    uint32_t header_size; // sizeof(TrajectoryHeader)
+    uint32_t num_bees;
+    uint32_t num_flowers;
+    float world_size;
+    float hive_radius;
+    uint64_t frame_size;
+    uint64_t frames_offset; // where the first frame starts
+    uint8_t reserved[16];
+} TrajectoryHeader;
+
+// Frames are written by a background thread. trajectory_write copies the
+// arrays it needs into one of num_buffers frame buffers and returns; the
+// thread writes full buffers in order while the simulation keeps stepping.
+// When every buffer is still waiting to be written, trajectory_write either
+// blocks until one is free or drops the frame (trajectory_drop).
+typedef struct
+{
+    int fd;
+    const char *path;
+    int num_bees;
+    int num_flowers;
+    size_t frame_size;
+
+    int num_buffers;
+    char **buffers;
+    int head, count; // buffers[head .. head + count) wait for the thread
+    int drop_when_full;
+    int closing;
+    int failed;
+
+    int frames;  // written
+    int dropped; // skipped because every buffer was full
+
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+} TrajectoryWriter;
+
+// trajectory_open writes the header and starts the thread; buffer count and
+// policy come from sim_config. Returns 0 on success.
+int trajectory_open(TrajectoryWriter *w, const char *path, Simulation *sim);
+// 0 if the frame was queued, 1 if it was dropped, -1 after a write error
+int trajectory_write(TrajectoryWriter *w, Simulation *sim);
+// Waits for the queued frames to reach the file
+void trajectory_close(TrajectoryWriter *w);
+
+#endif
@@ -1,12 +1,56 @@
 #ifndef TYPES_H
 #define TYPES_H
-#include <omp.h>
 
 typedef struct
 {
     float x, y;
 } Vector2D;
 
+// Run-time parameters that shape the run, defaults in config.h (see sim_config.h)
+typedef struct
+{
+    int num_bees;
+    int num_flowers;
+    int seed; // keys every random stream (rng.h)
+
+    float world_size;
+    float hive_radius;
+
+    float bee_speed;
+    float bee_vision_range;
+    float scout_ratio;
+    float max_energy;
+    float energy_cost;
+
+    float flower_nectar_max;
+    int flower_capacity;
+    float nectar_regen_rate;
+
+    int dance_duration;
+    float decision_probability;
+    int dance_watch_batch;
+    int sync_step;  // 1 = the whole watch reads the step's dance table (no batches)
+    int events;    // 1 = park bees whose next steps are known (calendar.h)
+} SimConfig;
+
+// Run-time parameters of how a run is executed and recorded, never its
+// outcome; these stay settable in a FIXED_CONFIG build
+typedef struct
+{
+    int max_timesteps;
+    int simd_width; // lanes of the flower scan and bee kernels: 0 = widest the CPU has, 1 = scalar
+
+    int trajectory_every;   // 0 = off, else a positions.bin frame every N steps
+    int trajectory_buffers; // frames queued for the writer thread
+    int trajectory_drop;    // 1 = drop frames when the queue is full, 0 = wait
+
+    int checkpoint_every; // 0 = off, else a checkpoint every N steps (checkpoint.h)
+    int stats_every;      // 0 = off, else print_statistics every N steps
+
+    int bench_repeats; // 0 = normal run, else timed repetitions (bench.h)
+    int bench_warmup;  // untimed steps before each repetition
+} RunConfig;
+
 typedef enum
 {
     IDLE,
@@ -17,33 +61,105 @@ typedef enum
     FORAGING
 } BeeState;
 
+#define NUM_BEE_STATES (FORAGING + 1)
+
+// Bee state as structure-of-arrays; a bee's id is its index.
+// Each behavior touches only the arrays it needs.
 typedef struct
 {
-    int id;
-    Vector2D position;
-    Vector2D velocity;
-    BeeState state;
+    float *x, *y;
+    float *energy;
+    unsigned char *state; // BeeState
+
+    int *target_flower;   //-1 if empty
+    int *following_dance; //-1 if empty
+    float *target_x, *target_y;
+
+    float *nectar_found;
+    int *dance_followers;
+    int *dance_timer;
+
+    float *flight_dist; // distance to target before this step's move, not synced
+} BeeArrays;
+
+// move_bees and bee_upkeep (bee_core.h) over n bees of ids, on one thread.
+// Picked at startup, see bee_kernels.h.
+typedef struct
+{
+    void (*move)(BeeArrays *bees, const int *ids, int n, int to_hive);
+    void (*upkeep)(BeeArrays *bees, const int *ids, int n);
+    const char *name; // "scalar", "avx2" or "avx512", for the run banner
+} BeeKernels;
+
+// Owned bee indices grouped by state
+typedef struct
+{
+    int *ids[NUM_BEE_STATES];
+    int count[NUM_BEE_STATES];
+    int capacity[NUM_BEE_STATES];
+    int *movers; // scratch for buckets_refresh and buckets_remove
+    int movers_capacity;
+} StateBuckets;
+
+// A bee on the calendar keeps the x, y, energy and dance_timer of park_step
+// and flies straight on until wake_step; see bee_position
+typedef struct
+{
+    int bee;
+    int park_step;
+    int wake_step;
+} ParkedBee;
+
+#define CALENDAR_CHUNK 256 // parked bees per chunk
 
-    float energy;
-    int target_flower;   //-1 if empty
-    int following_dance; //-1 if empty
-    Vector2D target_location;
+// A day is a list of chunks; all but its last one are full
+typedef struct CalendarChunk
+{
+    struct CalendarChunk *next;
+    int count;
+    ParkedBee bees[CALENDAR_CHUNK];
+} CalendarChunk;
 
-    float nectar_found;
-    int dance_followers;
-    int dance_timer;
-} Bee;
+// Parked bees by the step they wake at, see calendar.h
+typedef struct
+{
+    CalendarChunk **first;
+    CalendarChunk **last;
+    int *count;
+    int num_days; // a power of two
+    CalendarChunk *spare; // chunks of woken bees, reused before any malloc
+    int parked[NUM_BEE_STATES];
+    ParkedBee *due; // scratch for calendar_pop
+    int due_capacity;
+} Calendar;
 
+// Nectar regrows lazily: nectar_available is the amount at the start of step
+// nectar_step, and flower_nectar (bee_core.h) adds regen_rate per step since
+// then, up to nectar_total. Only a harvest that serves a bee writes it back.
 typedef struct
 {
     Vector2D position;
     float nectar_available;
     float nectar_total;
-    int bees_feeding;
+    float regen_rate; // nectar per step
+    int nectar_step;
     int capacity;
-    omp_lock_t lock;
 } Flower;
 
+// Distance kernel over flower position arrays, see flower_scan.h
+typedef int (*FlowerScan)(const float *x, const float *y, int begin, int end, float px, float py, float limit2);
+
+typedef struct
+{
+    float cell_size;
+    int cols, rows;
+    int *cell_start; // cols * rows + 1 offsets into flower_ids
+    int *flower_ids;
+    float *x, *y;    // flower positions in flower_ids order
+    FlowerScan scan;
+    float cell_limit2; // flower_scan_limit(cell_size)
+} FlowerGrid;
+
 typedef struct
 {
     int bee_id;
@@ -51,20 +167,66 @@ typedef struct
     float nectar_quality;
     float distance_from_hive;
     int followers;
+    int owner; // rank that owns the dancer (always 0 outside MPI)
 } WaggleDance;
 
+// State private to one thread of the update: the dances it created this
+// step and the recruits it counted per dance while watching. Every thread
+// allocates its own context inside the parallel region, so the memory is
+// first touched on that thread's NUMA node, and contexts are cache-line
+// aligned, so two threads never write to the same line.
 typedef struct
 {
-    Bee *bees;
+    _Alignas(64) WaggleDance *dances;
+    int num_dances;
+    int dance_capacity;
+    int dance_offset; // where its dances go in sim->dances
+    int *followers;   // per entry of sim->dances
+    int followers_capacity;
+} ThreadContext;
+
+// A forager asking for nectar at its target flower
+typedef struct
+{
+    int flower;
+    int bee;
+    int rank;        // rank that owns the bee (always 0 outside MPI)
+    float collected; // filled in by resolve_harvest
+} HarvestDemand;
+
+typedef struct
+{
+    BeeArrays bees;
+    StateBuckets buckets;
+    Calendar calendar; // bees parked out of their buckets (events)
     Flower *flowers;
     WaggleDance *dances;
+    float *dance_prefix; // running attractiveness totals, see build_dance_table
     int num_dances;
+    int dance_capacity; // of dances and dance_prefix, see reserve_dances
+    ThreadContext **threads; // by thread number, allocated by the thread itself
+    int num_threads;
 
-    float total_nectar_collected;
-    int timestep;
+    FlowerGrid flower_grid;
+    BeeKernels kernels;
+
+    HarvestDemand *demands; // filed by update_bees
+    int num_demands;
+    int demand_capacity;
+    int num_foragers; // leading entries of the FORAGING bucket awaiting a harvest
 
-    int num_local_bees;
-    int bee_offset;
+    // Scratch of the step phases, grown to the most a step has needed and
+    // kept, like buckets.movers and calendar.due
+    int *park_steps; // park_bees
+    int park_steps_capacity;
+    int *flower_counts; // group_demands, num_flowers + 1 once used
+    HarvestDemand *grouped;
+    int grouped_capacity;
+    int *group_start; // resolve_harvest
+    int group_start_capacity;
+
+    double total_nectar_collected; // float amounts, so the sum is exact
+    int timestep;
 } Simulation;
 
 #endif
\ No newline at end of file
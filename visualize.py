@@ -1,20 +1,59 @@
 """
 Bee Foraging Simulation - Visualization
-Reads positions.csv and creates animation
+Reads positions.bin (see trajectory.h) and creates animation
 """
 
-import pandas as pd
+import sys
 import matplotlib.pyplot as plt
 import matplotlib.animation as animation
 from matplotlib.patches import Circle
 import numpy as np
 
+HEADER_DTYPE = np.dtype([
+    ('magic', 'S8'),
+    ('version', '<u4'),
+    ('header_size', '<u4'),
+    ('num_bees', '<u4'),
+    ('num_flowers', '<u4'),
+    ('world_size', '<f4'),
+    ('hive_radius', '<f4'),
+    ('frame_size', '<u8'),
+    ('frames_offset', '<u8'),
+    ('reserved', 'u1', (16,)),
+])
+
+
+def load_trajectory(path):
+    """Memory-maps the frames; nothing is read until a frame is drawn."""
+    header = np.fromfile(path, dtype=HEADER_DTYPE, count=1)[0]
+    if header['magic'] != b'BEETRAJ' or header['version'] != 1:
+        sys.exit(f"{path} is not a version 1 trajectory file")
+
+    nb, nf = int(header['num_bees']), int(header['num_flowers'])
+    pad = (4 - nb % 4) % 4
+    fields = [('timestep', '<i4'), ('x', '<f4', (nb,)), ('y', '<f4', (nb,)), ('state', 'u1', (nb,))]
+    if pad:
+        fields.append(('pad', 'u1', (pad,)))
+    fields.append(('nectar', '<f4', (nf,)))
+    frame_dtype = np.dtype(fields)
+    assert frame_dtype.itemsize == header['frame_size']
+
+    flower_xy = np.memmap(path, dtype='<f4', mode='r', offset=int(header['header_size']), shape=(2, nf))
+
+    # a run that was cut short leaves a partial last frame; skip it
+    offset = int(header['frames_offset'])
+    data_bytes = np.memmap(path, dtype='u1', mode='r').size - offset
+    num_frames = data_bytes // frame_dtype.itemsize
+    frames = np.memmap(path, dtype=frame_dtype, mode='r', offset=offset, shape=(num_frames,))
+    return header, flower_xy, frames
+
+
 print("Loading data...")
-df = pd.read_csv('positions.csv')
+header, flower_xy, frames = load_trajectory(sys.argv[1] if len(sys.argv) > 1 else 'positions.bin')
 
-# Parametri (mora da odgovara config.h)
-WORLD_SIZE = 800.0
-HIVE_RADIUS = 10.0
+# Parametri (iz zaglavlja fajla)
+WORLD_SIZE = float(header['world_size'])
+HIVE_RADIUS = float(header['hive_radius'])
 HIVE_X = WORLD_SIZE / 2
 HIVE_Y = WORLD_SIZE / 2
 
@@ -37,9 +76,7 @@ STATE_NAMES = {
     5: 'Foraging'
 }
 
-# Uzmi sve timestep-ove
-timesteps = sorted(df['timestep'].unique())
-print(f"Found {len(timesteps)} timesteps")
+print(f"Found {len(frames)} frames")
 
 # Setup figure
 fig, ax = plt.subplots(figsize=(12, 10))
@@ -55,13 +92,11 @@ def animate(frame_idx):
     ax.set_aspect('equal')
     ax.set_facecolor('#f0f0f0')
     
-    t = timesteps[frame_idx]
+    frame = frames[frame_idx]
+    t = int(frame['timestep'])
     ax.set_title(f'Bee Foraging Simulation - Timestep: {t}', 
                  fontsize=16, fontweight='bold')
     
-    # Filtriraj podatke za ovaj timestep
-    frame_data = df[df['timestep'] == t]
-    
     # Crtaj košnicu
     hive = Circle((HIVE_X, HIVE_Y), HIVE_RADIUS, 
                   facecolor='brown', alpha=0.4, linewidth=2, 
@@ -69,26 +104,27 @@ def animate(frame_idx):
     ax.add_patch(hive)
     
     # Crtaj cvetove
-    flowers = frame_data[frame_data['type'] == 'flower']
-    if len(flowers) > 0:
+    num_flowers = flower_xy.shape[1]
+    if num_flowers > 0:
         # Veličina zavisi od dostupnog nektara
-        sizes = flowers['nectar'] * 3  # Scale factor
-        ax.scatter(flowers['x'], flowers['y'], 
+        sizes = frame['nectar'] * 3  # Scale factor
+        ax.scatter(flower_xy[0], flower_xy[1], 
                    c='pink', s=sizes, marker='*', 
                    edgecolors='red', linewidths=2, 
                    label='Flowers', zorder=2, alpha=0.8)
     
     # Crtaj pčele po stanju
-    bees = frame_data[frame_data['type'] == 'bee']
+    state_of = frame['state']
     
     legend_handles = []
     for state, color in STATE_COLORS.items():
-        state_bees = bees[bees['state'] == state]
-        if len(state_bees) > 0:
-            scatter = ax.scatter(state_bees['x'], state_bees['y'],
+        mask = state_of == state
+        count = int(np.count_nonzero(mask))
+        if count > 0:
+            scatter = ax.scatter(frame['x'][mask], frame['y'][mask],
                                 c=color, s=30, alpha=0.7,
                                 edgecolors='black', linewidths=0.5,
-                                label=f'{STATE_NAMES[state]} ({len(state_bees)})',
+                                label=f'{STATE_NAMES[state]} ({count})',
                                 zorder=3)
             legend_handles.append(scatter)
     
@@ -99,14 +135,14 @@ def animate(frame_idx):
     ax.legend(loc='upper right', fontsize=10, framealpha=0.9)
     
     # Statistika
-    stats_text = f"Bees: {len(bees)} | Flowers: {len(flowers)}"
+    stats_text = f"Bees: {len(state_of)} | Flowers: {num_flowers}"
     ax.text(0.02, 0.98, stats_text, 
             transform=ax.transAxes, fontsize=10,
             verticalalignment='top',
             bbox=dict(boxstyle='round', facecolor='white', alpha=0.8))
 
 print("Creating animation...")
-ani = animation.FuncAnimation(fig, animate, frames=len(timesteps), 
+ani = animation.FuncAnimation(fig, animate, frames=len(frames), 
                              interval=100, repeat=True, blit=False)
 
 print("Saving animation as bee_simulation.gif...")
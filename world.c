@@ -0,0 +1,126 @@
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "world.h"
+#include "sim_config.h"
+
+_Static_assert(sizeof(WorldHeader) == 64, "WorldHeader layout changed");
+
+#define STRINGIFY_(x) #x
+#define STRINGIFY(x) STRINGIFY_(x)
+
+static World world;
+static void *mapping = NULL;
+static size_t mapping_size = 0;
+static uint64_t identity = 0; // world_identity, computed on first use
+
+static uint64_t bee_pad(uint64_t num_bees)
+{
+    return (4 - num_bees % 4) % 4;
+}
+
+static uint64_t file_size(uint64_t num_bees, uint64_t num_flowers)
+{
+    return sizeof(WorldHeader) + num_bees * (3 * sizeof(float) + 1) + bee_pad(num_bees) +
+           num_flowers * (4 * sizeof(float) + sizeof(int32_t));
+}
+
+// Sets key only when it changes, so a FIXED_CONFIG build accepts a world
+// that matches its constants
+static int apply(const char *key, int is_int, int iv, float fv, int current_iv, float current_fv)
+{
+    if (is_int ? iv == current_iv : fv == current_fv)
+        return 0;
+    char value[32];
+    if (is_int)
+        snprintf(value, sizeof(value), "%d", iv);
+    else
+        snprintf(value, sizeof(value), "%.9g", fv);
+    return config_set(key, value);
+}
+
+const char *world_open(const char *path)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return "cannot be opened";
+
+    struct stat st;
+    WorldHeader h;
+    if (fstat(fd, &st) != 0 || pread(fd, &h, sizeof(h), 0) != (ssize_t)sizeof(h) ||
+        memcmp(h.magic, WORLD_MAGIC, sizeof(WORLD_MAGIC)) != 0 || h.version != WORLD_VERSION ||
+        h.header_size != sizeof(WorldHeader))
+    {
+        close(fd);
+        return "is not a version " STRINGIFY(WORLD_VERSION) " world file";
+    }
+    if (h.num_bees > 0x7fffffff || h.num_flowers > 0x7fffffff ||
+        (uint64_t)st.st_size != file_size(h.num_bees, h.num_flowers))
+    {
+        close(fd);
+        return "has the wrong size for its header";
+    }
+
+    void *p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED)
+        return "cannot be mapped";
+
+    if (mapping)
+        munmap(mapping, mapping_size);
+    identity = 0;
+    mapping = p;
+    mapping_size = st.st_size;
+
+    uint64_t nb = h.num_bees, nf = h.num_flowers;
+    const char *base = (const char *)p + sizeof(WorldHeader);
+    world.num_bees = (int)nb;
+    world.num_flowers = (int)nf;
+    world.bee_x = (const float *)base;
+    world.bee_y = world.bee_x + nb;
+    world.bee_energy = world.bee_y + nb;
+    world.bee_state = (const uint8_t *)(world.bee_energy + nb);
+    world.flower_x = (const float *)(world.bee_state + nb + bee_pad(nb));
+    world.flower_y = world.flower_x + nf;
+    world.flower_nectar = world.flower_y + nf;
+    world.flower_regen = world.flower_nectar + nf;
+    world.flower_capacity = (const int32_t *)(world.flower_regen + nf);
+
+    if (apply("num_bees", 1, (int)nb, 0, sim_config.num_bees, 0) != 0 ||
+        apply("num_flowers", 1, (int)nf, 0, sim_config.num_flowers, 0) != 0 ||
+        apply("world_size", 0, 0, h.world_size, 0, sim_config.world_size) != 0 ||
+        apply("hive_radius", 0, 0, h.hive_radius, 0, sim_config.hive_radius) != 0)
+        return "does not fit this configuration";
+    return NULL;
+}
+
+const World *world_current(void)
+{
+    return mapping ? &world : NULL;
+}
+
+static uint64_t fnv1a(uint64_t hash, const void *data, size_t len)
+{
+    const unsigned char *p = (const unsigned char *)data;
+    for (size_t i = 0; i < len; i++)
+    {
+        hash ^= p[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+uint64_t world_identity(void)
+{
+    if (!mapping || identity != 0)
+        return identity;
+
+    const char *flowers = (const char *)world.flower_x;
+    uint64_t hash = fnv1a(0xcbf29ce484222325ULL, mapping, sizeof(WorldHeader));
+    hash = fnv1a(hash, flowers, (const char *)mapping + mapping_size - flowers);
+    identity = hash != 0 ? hash : 1;
+    return identity;
+}
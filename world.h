@@ -0,0 +1,60 @@
+#ifndef WORLD_H
+#define WORLD_H
+#include <stdint.h>
+
+// Pre-generated world (--world FILE), written by make_world.py. All values
+// are little-endian. Layout:
+//
+//   WorldHeader                      64 bytes
+//   float   bee_x[num_bees]          ascending, so every strip of the world
+//   float   bee_y[num_bees]          is one contiguous range of bee ids
+//   float   bee_energy[num_bees]
+//   uint8_t bee_state[num_bees]      BeeState
+//   uint8_t pad[]                    to a multiple of 4 bytes
+//   float   flower_x[num_flowers]
+//   float   flower_y[num_flowers]
+//   float   flower_nectar[num_flowers]   nectar_total, also the starting nectar
+//   float   flower_regen[num_flowers]    nectar regrown per step
+//   int32_t flower_capacity[num_flowers]
+//
+// The file is memory-mapped read-only, so a rank only pages in the bees of
+// its own strip (and the flowers, which every rank keeps).
+
+#define WORLD_MAGIC "BEEWRLD"
+#define WORLD_VERSION 2
+
+typedef struct
+{
+    char magic[8]; // WORLD_MAGIC, NUL-terminated
+    uint32_t version;
+    uint32_t header_size; // sizeof(WorldHeader)
+    uint32_t num_bees;
+    uint32_t num_flowers;
+    float world_size;
+    float hive_radius;
+    uint8_t reserved[32];
+} WorldHeader;
+
+typedef struct
+{
+    int num_bees, num_flowers;
+    const float *bee_x, *bee_y, *bee_energy;
+    const uint8_t *bee_state;
+    const float *flower_x, *flower_y, *flower_nectar, *flower_regen;
+    const int32_t *flower_capacity;
+} World;
+
+// Maps path, checks its layout and sets num_bees, num_flowers, world_size and
+// hive_radius from the header. The file stays mapped for the rest of the
+// run. Returns NULL on success, else what is wrong with the file.
+const char *world_open(const char *path);
+
+// The mapped world, or NULL when the world is generated from the seed
+const World *world_current(void);
+
+// Identifies the world a run starts from: 0 for a generated world, else a
+// nonzero FNV-1a hash of the header and the flower arrays of the file (the
+// bees are left out, so no rank pages in the whole colony).
+uint64_t world_identity(void);
+
+#endif